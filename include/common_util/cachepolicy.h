@@ -0,0 +1,856 @@
+/**
+ * @copyright Copyright (c) 2025, Spencer.Luo. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the
+ * License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing permissions and
+ * limitations.
+ *
+ * @file cachepolicy.h
+ * @brief Pluggable cache eviction policies (LRU, 2Q, ARC, W-TinyLFU) and a cache using them.
+ * @author Spencer
+ * @date 2026-10-18
+ *
+ * An eviction policy tracks the keys of a cache (not the values) and decides which keys to keep.
+ * All the policies have the same interface, so that they can be used by policy_cache or driven
+ * directly by a trace simulator:
+ *
+ *     explicit Policy(size_t capacity);
+ *     // Whether the key is resident in the cache
+ *     bool contains(const K& key) const;
+ *     // Record an access of the key, return true if the key is resident (a hit)
+ *     bool touch(const K& key);
+ *     // Add a key which is not resident, the keys evicted (may include the key itself if it is
+ *     // not admitted) are appended to evicted
+ *     void insert(const K& key, std::vector<K>& evicted);
+ *     // Remove a resident key
+ *     void erase(const K& key);
+ *     size_t size() const;
+ *     size_t capacity() const;
+ *     void clear();
+ *
+ * The policies are not thread-safe, policy_cache locks them with its mutex.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace cutl
+{
+
+/**
+ * @brief Several queues (doubly linked lists) of keys with an index of which queue each key is in,
+ * the building block of the eviction policies.
+ *
+ * @tparam K The Type of Key
+ * @tparam Hash The hash function of the key
+ */
+template<typename K, typename Hash = std::hash<K>>
+class cache_queues
+{
+public:
+    /**
+     * @brief The queue id of the keys not in any queue.
+     *
+     */
+    static constexpr int npos = -1;
+
+    /**
+     * @brief Construct a new cache_queues object
+     *
+     * @param queue_count The number of queues, the queue ids are [0, queue_count)
+     */
+    explicit cache_queues(int queue_count)
+      : queues_(queue_count)
+    {
+    }
+
+    /**
+     * @brief Get the queue id of the key.
+     *
+     * @param key
+     * @return int the queue id, or npos if the key is not in any queue.
+     */
+    int find(const K& key) const
+    {
+        auto itr = map_.find(key);
+        return itr == map_.end() ? npos : itr->second.queue;
+    }
+
+    /**
+     * @brief Get the number of keys in the queue.
+     *
+     * @param queue the queue id
+     * @return size_t
+     */
+    size_t size(int queue) const { return queues_[queue].size(); }
+
+    /**
+     * @brief Get the least recently added key of the queue, the queue must not be empty.
+     *
+     * @param queue the queue id
+     * @return const K&
+     */
+    const K& back(int queue) const { return queues_[queue].back(); }
+
+    /**
+     * @brief Move the key to the front of the queue. If the key is not in any queue, add it.
+     *
+     * @param queue the queue id
+     * @param key
+     */
+    void move_to_front(int queue, const K& key)
+    {
+        auto itr = map_.find(key);
+        if (itr == map_.end())
+        {
+            queues_[queue].push_front(key);
+            map_.emplace(key, position{ queue, queues_[queue].begin() });
+            return;
+        }
+
+        // splice不会使迭代器失效，也不需要重新分配节点
+        position& pos = itr->second;
+        queues_[queue].splice(queues_[queue].begin(), queues_[pos.queue], pos.itr);
+        pos.queue = queue;
+    }
+
+    /**
+     * @brief Remove the key from its queue.
+     *
+     * @param key
+     * @return true if the key was in a queue
+     */
+    bool erase(const K& key)
+    {
+        auto itr = map_.find(key);
+        if (itr == map_.end())
+        {
+            return false;
+        }
+        queues_[itr->second.queue].erase(itr->second.itr);
+        map_.erase(itr);
+        return true;
+    }
+
+    /**
+     * @brief Remove all the keys.
+     *
+     */
+    void clear()
+    {
+        for (auto& queue : queues_)
+        {
+            queue.clear();
+        }
+        map_.clear();
+    }
+
+private:
+    struct position
+    {
+        int queue;
+        typename std::list<K>::iterator itr;
+    };
+
+    std::vector<std::list<K>> queues_;
+    std::unordered_map<K, position, Hash> map_;
+};
+
+template<typename K, typename Hash>
+constexpr int cache_queues<K, Hash>::npos;
+
+/**
+ * @brief The least recently used policy, the baseline of the other policies.
+ *
+ * @tparam K The Type of Key
+ * @tparam Hash The hash function of the key
+ */
+template<typename K, typename Hash = std::hash<K>>
+class lru_policy
+{
+public:
+    explicit lru_policy(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1))
+      , queues_(1)
+    {
+    }
+
+    bool contains(const K& key) const { return queues_.find(key) == 0; }
+
+    bool touch(const K& key)
+    {
+        if (queues_.find(key) != 0)
+        {
+            return false;
+        }
+        queues_.move_to_front(0, key);
+        return true;
+    }
+
+    void insert(const K& key, std::vector<K>& evicted)
+    {
+        queues_.move_to_front(0, key);
+        if (queues_.size(0) > capacity_)
+        {
+            evicted.push_back(queues_.back(0));
+            queues_.erase(evicted.back());
+        }
+    }
+
+    void erase(const K& key) { queues_.erase(key); }
+
+    size_t size() const { return queues_.size(0); }
+
+    size_t capacity() const { return capacity_; }
+
+    void clear() { queues_.clear(); }
+
+private:
+    size_t capacity_;
+    cache_queues<K, Hash> queues_;
+};
+
+/**
+ * @brief The 2Q policy (the full version of Johnson & Shasha).
+ * A new key enters the FIFO queue A1in first, and the keys evicted from A1in are remembered in the
+ * ghost queue A1out (keys only). Only a key accessed again while in A1out is promoted to the LRU
+ * queue Am, so a scan passes through A1in without flushing the hot keys in Am.
+ *
+ * @tparam K The Type of Key
+ * @tparam Hash The hash function of the key
+ */
+template<typename K, typename Hash = std::hash<K>>
+class two_queue_policy
+{
+public:
+    /**
+     * @brief Construct a new two_queue_policy object
+     *
+     * @param capacity The maximum number of resident keys
+     * @param in_ratio The capacity of A1in relative to capacity, 25% by default
+     * @param out_ratio The capacity of the ghost queue A1out relative to capacity, 50% by default
+     */
+    explicit two_queue_policy(size_t capacity, double in_ratio = 0.25, double out_ratio = 0.5)
+      : capacity_(std::max<size_t>(capacity, 1))
+      , in_capacity_(std::max<size_t>(static_cast<size_t>(capacity_ * in_ratio), 1))
+      , out_capacity_(std::max<size_t>(static_cast<size_t>(capacity_ * out_ratio), 1))
+      , queues_(3)
+    {
+    }
+
+    bool contains(const K& key) const
+    {
+        int queue = queues_.find(key);
+        return queue == a1_in || queue == a_m;
+    }
+
+    bool touch(const K& key)
+    {
+        int queue = queues_.find(key);
+        if (queue == a_m)
+        {
+            queues_.move_to_front(a_m, key);
+            return true;
+        }
+        // A1in中的key被再次访问时不调整位置，短时间内的重复访问不能说明是热点
+        return queue == a1_in;
+    }
+
+    void insert(const K& key, std::vector<K>& evicted)
+    {
+        if (queues_.find(key) == a1_out)
+        {
+            queues_.move_to_front(a_m, key);
+        }
+        else
+        {
+            queues_.move_to_front(a1_in, key);
+        }
+
+        while (size() > capacity_)
+        {
+            if (queues_.size(a1_in) > in_capacity_ || queues_.size(a_m) == 0)
+            {
+                // A1in淘汰的key记录到A1out
+                const K& victim = queues_.back(a1_in);
+                evicted.push_back(victim);
+                queues_.move_to_front(a1_out, victim);
+                if (queues_.size(a1_out) > out_capacity_)
+                {
+                    queues_.erase(queues_.back(a1_out));
+                }
+            }
+            else
+            {
+                evicted.push_back(queues_.back(a_m));
+                queues_.erase(evicted.back());
+            }
+        }
+    }
+
+    void erase(const K& key)
+    {
+        if (contains(key))
+        {
+            queues_.erase(key);
+        }
+    }
+
+    size_t size() const { return queues_.size(a1_in) + queues_.size(a_m); }
+
+    size_t capacity() const { return capacity_; }
+
+    void clear() { queues_.clear(); }
+
+private:
+    static constexpr int a1_in = 0;
+    static constexpr int a_m = 1;
+    static constexpr int a1_out = 2;
+
+    size_t capacity_;
+    size_t in_capacity_;
+    size_t out_capacity_;
+    cache_queues<K, Hash> queues_;
+};
+
+/**
+ * @brief The adaptive replacement cache policy (ARC, Megiddo & Modha).
+ * The resident keys are split into T1 (seen once recently) and T2 (seen at least twice), with the
+ * ghost queues B1 and B2 remembering the keys evicted from them. A hit in a ghost queue adapts the
+ * target size of T1, so the policy balances between recency and frequency by itself.
+ *
+ * @tparam K The Type of Key
+ * @tparam Hash The hash function of the key
+ */
+template<typename K, typename Hash = std::hash<K>>
+class arc_policy
+{
+public:
+    explicit arc_policy(size_t capacity)
+      : capacity_(std::max<size_t>(capacity, 1))
+      , target_(0)
+      , queues_(4)
+    {
+    }
+
+    bool contains(const K& key) const
+    {
+        int queue = queues_.find(key);
+        return queue == t1 || queue == t2;
+    }
+
+    bool touch(const K& key)
+    {
+        if (!contains(key))
+        {
+            return false;
+        }
+        queues_.move_to_front(t2, key);
+        return true;
+    }
+
+    void insert(const K& key, std::vector<K>& evicted)
+    {
+        int queue = queues_.find(key);
+        size_t b1_size = queues_.size(b1);
+        size_t b2_size = queues_.size(b2);
+        if (queue == b1)
+        {
+            // B1命中说明T1偏小，增大T1的目标大小
+            target_ = std::min(capacity_, target_ + std::max<size_t>(b2_size / b1_size, 1));
+            replace(false, evicted);
+            queues_.move_to_front(t2, key);
+            return;
+        }
+        if (queue == b2)
+        {
+            // B2命中说明T2偏小，减小T1的目标大小
+            size_t delta = std::max<size_t>(b1_size / b2_size, 1);
+            target_ = target_ > delta ? target_ - delta : 0;
+            replace(true, evicted);
+            queues_.move_to_front(t2, key);
+            return;
+        }
+
+        size_t l1_size = queues_.size(t1) + b1_size;
+        if (l1_size >= capacity_)
+        {
+            if (queues_.size(t1) < capacity_)
+            {
+                queues_.erase(queues_.back(b1));
+                replace(false, evicted);
+            }
+            else
+            {
+                evicted.push_back(queues_.back(t1));
+                queues_.erase(evicted.back());
+            }
+        }
+        else if (l1_size + queues_.size(t2) + b2_size >= capacity_)
+        {
+            if (l1_size + queues_.size(t2) + b2_size >= capacity_ * 2)
+            {
+                queues_.erase(queues_.back(b2));
+            }
+            replace(false, evicted);
+        }
+        queues_.move_to_front(t1, key);
+    }
+
+    void erase(const K& key)
+    {
+        if (contains(key))
+        {
+            queues_.erase(key);
+        }
+    }
+
+    size_t size() const { return queues_.size(t1) + queues_.size(t2); }
+
+    size_t capacity() const { return capacity_; }
+
+    void clear()
+    {
+        queues_.clear();
+        target_ = 0;
+    }
+
+private:
+    static constexpr int t1 = 0;
+    static constexpr int t2 = 1;
+    static constexpr int b1 = 2;
+    static constexpr int b2 = 3;
+
+    // 缓存已满时，从T1或T2淘汰一个key到对应的ghost队列
+    void replace(bool hit_b2, std::vector<K>& evicted)
+    {
+        if (size() < capacity_)
+        {
+            return;
+        }
+
+        size_t t1_size = queues_.size(t1);
+        if (t1_size > 0 && (t1_size > target_ || (hit_b2 && t1_size == target_) ||
+                            queues_.size(t2) == 0))
+        {
+            evicted.push_back(queues_.back(t1));
+            queues_.move_to_front(b1, evicted.back());
+        }
+        else
+        {
+            evicted.push_back(queues_.back(t2));
+            queues_.move_to_front(b2, evicted.back());
+        }
+    }
+
+    size_t capacity_;
+    // T1的目标大小(论文中的p)
+    size_t target_;
+    cache_queues<K, Hash> queues_;
+};
+
+/**
+ * @brief A count-min sketch with 4-bit counters, estimates the access frequency of the keys in a
+ * fixed amount of memory. All the counters are halved after every sample_size increments, so that
+ * the frequency reflects the recent accesses (the aging of TinyLFU).
+ *
+ */
+class frequency_sketch
+{
+public:
+    /**
+     * @brief Construct a new frequency_sketch object
+     *
+     * @param capacity The number of keys to be estimated (usually the capacity of the cache)
+     */
+    explicit frequency_sketch(size_t capacity)
+      : additions_(0)
+    {
+        // 每个64位整数保存16个4位计数器，每个key使用4个计数器
+        size_t size = 1;
+        while (size < std::max<size_t>(capacity, 16) / 4)
+        {
+            size <<= 1;
+        }
+        table_.assign(size, 0);
+        sample_size_ = std::max<size_t>(capacity, 16) * 10;
+    }
+
+    /**
+     * @brief Increase the frequency of the key (by its hash value), at most 15.
+     *
+     * @param hash the hash value of the key
+     */
+    void increment(uint64_t hash)
+    {
+        bool added = false;
+        for (int i = 0; i < depth; i++)
+        {
+            uint64_t& word = table_[index_of(hash, i)];
+            int shift = offset_of(hash, i);
+            if (((word >> shift) & 0xF) < 0xF)
+            {
+                word += static_cast<uint64_t>(1) << shift;
+                added = true;
+            }
+        }
+
+        if (added && ++additions_ >= sample_size_)
+        {
+            reset();
+        }
+    }
+
+    /**
+     * @brief Get the estimated frequency of the key (by its hash value).
+     *
+     * @param hash the hash value of the key
+     * @return int the frequency in [0, 15]
+     */
+    int frequency(uint64_t hash) const
+    {
+        int result = 0xF;
+        for (int i = 0; i < depth; i++)
+        {
+            uint64_t word = table_[index_of(hash, i)];
+            result = std::min(result, static_cast<int>((word >> offset_of(hash, i)) & 0xF));
+        }
+        return result;
+    }
+
+    /**
+     * @brief Halve all the counters.
+     *
+     */
+    void reset()
+    {
+        for (auto& word : table_)
+        {
+            word = (word >> 1) & 0x7777777777777777ULL;
+        }
+        additions_ /= 2;
+    }
+
+    /**
+     * @brief Clear all the counters.
+     *
+     */
+    void clear()
+    {
+        std::fill(table_.begin(), table_.end(), 0);
+        additions_ = 0;
+    }
+
+private:
+    static constexpr int depth = 4;
+
+    // 每一行使用不同的种子重新打散哈希值
+    static uint64_t rehash(uint64_t hash, int i)
+    {
+        static const uint64_t seeds[depth] = { 0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                                               0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL };
+        uint64_t h = (hash + seeds[i]) * 0x9E3779B97F4A7C15ULL;
+        return h ^ (h >> 32);
+    }
+
+    size_t index_of(uint64_t hash, int i) const { return rehash(hash, i) & (table_.size() - 1); }
+
+    // 4位计数器在64位整数中的偏移
+    static int offset_of(uint64_t hash, int i) { return static_cast<int>(rehash(hash, i) >> 60) << 2; }
+
+    std::vector<uint64_t> table_;
+    size_t sample_size_;
+    size_t additions_;
+};
+
+/**
+ * @brief The W-TinyLFU policy (Einziger, Friedman & Manes, used by Caffeine).
+ * A new key enters a small LRU window (1% of the capacity by default). A key evicted from the window
+ * is admitted to the main segmented LRU (probation + protected) only if its estimated frequency,
+ * counted by a frequency_sketch, is higher than the one of the key the main space would evict. So a
+ * scan of one-hit keys only churns the window and the hot keys stay in the main space.
+ *
+ * @tparam K The Type of Key
+ * @tparam Hash The hash function of the key
+ */
+template<typename K, typename Hash = std::hash<K>>
+class wtinylfu_policy
+{
+public:
+    /**
+     * @brief Construct a new wtinylfu_policy object
+     *
+     * @param capacity The maximum number of resident keys
+     * @param window_ratio The capacity of the window relative to capacity, 1% by default
+     */
+    explicit wtinylfu_policy(size_t capacity, double window_ratio = 0.01)
+      : capacity_(std::max<size_t>(capacity, 1))
+      , window_capacity_(std::max<size_t>(static_cast<size_t>(capacity_ * window_ratio), 1))
+      , main_capacity_(capacity_ > window_capacity_ ? capacity_ - window_capacity_ : 0)
+      , protected_capacity_(static_cast<size_t>(main_capacity_ * 0.8))
+      , sketch_(capacity_)
+      , queues_(3)
+    {
+    }
+
+    bool contains(const K& key) const { return queues_.find(key) != cache_queues<K, Hash>::npos; }
+
+    bool touch(const K& key)
+    {
+        sketch_.increment(hash_of(key));
+        int queue = queues_.find(key);
+        if (queue == window)
+        {
+            queues_.move_to_front(window, key);
+        }
+        else if (queue == probation)
+        {
+            // 在probation中再次被访问，晋升到protected
+            queues_.move_to_front(protected_, key);
+            if (queues_.size(protected_) > protected_capacity_)
+            {
+                queues_.move_to_front(probation, queues_.back(protected_));
+            }
+        }
+        else if (queue == protected_)
+        {
+            queues_.move_to_front(protected_, key);
+        }
+        return queue != cache_queues<K, Hash>::npos;
+    }
+
+    void insert(const K& key, std::vector<K>& evicted)
+    {
+        queues_.move_to_front(window, key);
+        if (queues_.size(window) <= window_capacity_)
+        {
+            return;
+        }
+
+        // 窗口淘汰的key作为候选者进入probation，主空间满时与probation的队尾比较频率
+        K candidate = queues_.back(window);
+        queues_.move_to_front(probation, candidate);
+        if (queues_.size(probation) + queues_.size(protected_) <= main_capacity_)
+        {
+            return;
+        }
+
+        int victim_queue = queues_.size(probation) > 1 ? probation : protected_;
+        if (main_capacity_ == 0 || queues_.size(victim_queue) == 0)
+        {
+            evicted.push_back(candidate);
+        }
+        else
+        {
+            const K& victim = queues_.back(victim_queue);
+            bool admit = sketch_.frequency(hash_of(candidate)) > sketch_.frequency(hash_of(victim));
+            evicted.push_back(admit ? victim : candidate);
+        }
+        queues_.erase(evicted.back());
+    }
+
+    void erase(const K& key) { queues_.erase(key); }
+
+    size_t size() const
+    {
+        return queues_.size(window) + queues_.size(probation) + queues_.size(protected_);
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    void clear()
+    {
+        queues_.clear();
+        sketch_.clear();
+    }
+
+private:
+    static constexpr int window = 0;
+    static constexpr int probation = 1;
+    static constexpr int protected_ = 2;
+
+    static uint64_t hash_of(const K& key) { return static_cast<uint64_t>(Hash()(key)); }
+
+    size_t capacity_;
+    size_t window_capacity_;
+    size_t main_capacity_;
+    size_t protected_capacity_;
+    frequency_sketch sketch_;
+    cache_queues<K, Hash> queues_;
+};
+
+/**
+ * @brief A thread-safe cache whose eviction is decided by a pluggable policy, for the workloads on
+ * which LRU performs poorly, e.g. the periodic scans which flush the hot keys out of an LRU cache.
+ *
+ * @tparam K The Type of Key
+ * @tparam V The Type of Value
+ * @tparam Hash The hash function of the key
+ * @tparam Policy The eviction policy: lru_policy, two_queue_policy, arc_policy or wtinylfu_policy,
+ * which should use the same hash function as the cache
+ */
+template<typename K,
+         typename V,
+         typename Hash = std::hash<K>,
+         typename Policy = wtinylfu_policy<K, Hash>>
+class policy_cache
+{
+public:
+    /**
+     * @brief Construct a new policy_cache object
+     *
+     * @param capacity The maximum capacity of the cache
+     */
+    explicit policy_cache(size_t capacity)
+      : policy_(capacity)
+    {
+    }
+
+    // 不可以复制
+    policy_cache(const policy_cache&) = delete;
+    policy_cache& operator=(const policy_cache&) = delete;
+
+    /**
+     * @brief Whether the cache contains the key, the access is not recorded.
+     *
+     * @param key
+     * @return true
+     * @return false
+     */
+    bool exist(const K& key) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return values_.count(key) > 0;
+    }
+
+    /**
+     * @brief Get the value of the key, if the key does not exist, return a default value.
+     *
+     * @param key The key to get the value of
+     * @return V The value of the key, or a default value if the key does not exist.
+     */
+    V get(const K& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!policy_.touch(key))
+        {
+            return V();
+        }
+        return values_.find(key)->second;
+    }
+
+    /**
+     * @brief Get the value of the key by assigning it to out.
+     *
+     * @param key The key to get the value of
+     * @param out The value of the key, unchanged if the key does not exist
+     * @return true if the key exists
+     */
+    bool try_get(const K& key, V& out)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!policy_.touch(key))
+        {
+            return false;
+        }
+        out = values_.find(key)->second;
+        return true;
+    }
+
+    /**
+     * @brief Put the key-value pair into the cache. If the key already exists, update the value.
+     * @note The policy may not admit a new key (W-TinyLFU), in which case it is dropped at once.
+     *
+     * @param key The key to put the value of
+     * @param value The value to put into the cache
+     */
+    void put(const K& key, const V& value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto itr = values_.find(key);
+        if (itr != values_.end())
+        {
+            itr->second = value;
+            policy_.touch(key);
+            return;
+        }
+
+        evicted_.clear();
+        policy_.insert(key, evicted_);
+        values_.emplace(key, value);
+        for (const auto& victim : evicted_)
+        {
+            values_.erase(victim);
+        }
+    }
+
+    /**
+     * @brief Remove the key from the cache.
+     *
+     * @param key
+     * @return true if the key existed
+     */
+    bool erase(const K& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (values_.erase(key) == 0)
+        {
+            return false;
+        }
+        policy_.erase(key);
+        return true;
+    }
+
+    /**
+     * @brief Clean the cache, remove all elements and the access history.
+     *
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        values_.clear();
+        policy_.clear();
+    }
+
+    /**
+     * @brief Get the number of elements in the cache.
+     *
+     * @return size_t
+     */
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return values_.size();
+    }
+
+    /**
+     * @brief Get the maximum capacity of the cache.
+     *
+     * @return size_t
+     */
+    size_t capacity() const { return policy_.capacity(); }
+
+private:
+    mutable std::mutex mutex_;
+    Policy policy_;
+    std::unordered_map<K, V, Hash> values_;
+    // 复用淘汰列表的内存
+    std::vector<K> evicted_;
+};
+
+} // namespace cutl
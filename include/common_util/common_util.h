@@ -22,8 +22,10 @@
 #include "algoutil.h"
 #include "bitmap.h"
 #include "bloomfilter.h"
+#include "cachepolicy.h"
 #include "color.h"
 #include "config.h"
+#include "coroutine.h"
 #include "datetime.h"
 #include "dlloader.h"
 #include "eventloop.h"
@@ -31,14 +33,18 @@
 // #include "filetype.h"
 #include "fileutil.h"
 #include "hash.h"
+#include "histogram.h"
 #include "hyperloglog.h"
 // #include "logtype.h"
 #include "lrucache.h"
+#include "mpmc_queue.h"
+#include "parallel.h"
 #include "print.h"
 #include "singleton.h"
 #include "strfmt.h"
 #include "strutil.h"
 #include "sysutil.h"
+#include "task_function.h"
 #include "threadpool.h"
 #include "threadutil.h"
 #include "timecount.h"
@@ -0,0 +1,609 @@
+/**
+ * @copyright Copyright (c) 2025, Spencer.Luo. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the
+ * License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing permissions and
+ * limitations.
+ *
+ * @file coroutine.h
+ * @brief C++20 coroutine support for eventloop: task<T>, co_spawn, sync_wait, and awaitables of
+ * switch_to, sleep_for, wait_fd and when_all. Only available when the compiler supports C++20
+ * coroutines (CUTL_HAS_COROUTINE is 1).
+ * @author Spencer
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+// 编译器支持C++20协程时才启用
+#if defined(__has_include)
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define CUTL_HAS_COROUTINE 1
+#endif
+#endif
+
+#ifndef CUTL_HAS_COROUTINE
+#define CUTL_HAS_COROUTINE 0
+#endif
+
+#if CUTL_HAS_COROUTINE
+
+#include "eventloop.h"
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cutl
+{
+
+template<typename T = void>
+class task;
+
+namespace detail
+{
+
+// 协程结束时恢复等待者(对称转移，不增加调用栈深度)
+struct task_final_awaiter
+{
+    bool await_ready() const noexcept { return false; }
+
+    template<typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept
+    {
+        auto continuation = h.promise().continuation_;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+};
+
+struct task_promise_base
+{
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    task_final_awaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() noexcept { error_ = std::current_exception(); }
+
+    std::coroutine_handle<> continuation_;
+    std::exception_ptr error_;
+};
+
+template<typename T>
+struct task_promise : task_promise_base
+{
+    task<T> get_return_object() noexcept;
+
+    template<typename U>
+    void return_value(U&& value)
+    {
+        value_.emplace(std::forward<U>(value));
+    }
+
+    T result()
+    {
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+        return std::move(*value_);
+    }
+
+    std::optional<T> value_;
+};
+
+template<>
+struct task_promise<void> : task_promise_base
+{
+    task<void> get_return_object() noexcept;
+
+    void return_void() noexcept {}
+
+    void result()
+    {
+        if (error_)
+        {
+            std::rethrow_exception(error_);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief A lazily started coroutine which produces a value of type T.
+ * The coroutine starts when it is awaited by co_await, and the awaiting coroutine is resumed in
+ * the thread where the task completes. Use switch_to() to continue on a specific event loop.
+ *
+ * @tparam T the type of the result, void means no result
+ */
+template<typename T>
+class task
+{
+public:
+    using promise_type = detail::task_promise<T>;
+    using handle_type = std::coroutine_handle<promise_type>;
+
+    task() noexcept = default;
+
+    explicit task(handle_type handle) noexcept
+      : handle_(handle)
+    {
+    }
+
+    task(task&& other) noexcept
+      : handle_(std::exchange(other.handle_, nullptr))
+    {
+    }
+
+    task& operator=(task&& other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~task() { destroy(); }
+
+    // 不可以复制
+    task(const task&) = delete;
+    task& operator=(const task&) = delete;
+
+    /**
+     * @brief Whether the task holds a coroutine or not.
+     *
+     * @return true
+     * @return false
+     */
+    explicit operator bool() const noexcept { return static_cast<bool>(handle_); }
+
+    // co_await task: 启动协程，协程结束后恢复等待者
+    auto operator co_await() && noexcept
+    {
+        struct awaiter
+        {
+            handle_type handle_;
+
+            bool await_ready() const noexcept { return !handle_ || handle_.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle_.promise().continuation_ = awaiting;
+                return handle_;
+            }
+
+            T await_resume()
+            {
+                if (!handle_)
+                {
+                    throw std::logic_error("await an empty task");
+                }
+                return handle_.promise().result();
+            }
+        };
+        return awaiter{ handle_ };
+    }
+
+private:
+    void destroy()
+    {
+        if (handle_)
+        {
+            handle_.destroy();
+            handle_ = nullptr;
+        }
+    }
+
+private:
+    handle_type handle_;
+};
+
+namespace detail
+{
+
+template<typename T>
+task<T> task_promise<T>::get_return_object() noexcept
+{
+    return task<T>(std::coroutine_handle<task_promise<T>>::from_promise(*this));
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+    return task<void>(std::coroutine_handle<task_promise<void>>::from_promise(*this));
+}
+
+// 立即执行、结束后自动销毁的协程，用于co_spawn和when_all
+struct detached_task
+{
+    struct promise_type
+    {
+        detached_task get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        // 异常已在协程体内捕获
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+// 投递失败时，在调用线程中恢复协程并抛出异常
+inline void throw_if_post_failed(bool failed, const char* what)
+{
+    if (failed)
+    {
+        throw std::runtime_error(what);
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Awaitable to continue the coroutine in the thread of the event loop.
+ * It completes immediately if the coroutine is already in the event loop thread.
+ * @note Throw std::runtime_error if the task can not be posted to the event loop: the queue is
+ * full (drop_newest, block), or the overflow policy is caller_runs, in which case the coroutine
+ * would keep running in the calling thread instead of the event loop.
+ * @warning Do not use it with the drop_oldest overflow policy: the discarded task may be the resume
+ * of another coroutine, which is then never resumed and leaks.
+ *
+ * @param loop the event loop
+ * @return an awaitable object
+ */
+inline auto switch_to(eventloop& loop)
+{
+    struct awaiter
+    {
+        eventloop& loop_;
+        bool failed_;
+
+        bool await_ready() const { return loop_.is_loop_thread(); }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            // caller_runs策略下任务在调用线程中同步执行，此时不恢复协程(不在事件循环线程中)，
+            // 由await_resume抛出异常；调用线程不是事件循环线程(await_ready为false)，可以用线程id区分
+            auto caller = std::this_thread::get_id();
+            auto status = loop_.post_event(
+              [h, caller]()
+              {
+                  if (std::this_thread::get_id() != caller)
+                  {
+                      h.resume();
+                  }
+              });
+            if (status == eventloop_post_status::rejected ||
+                status == eventloop_post_status::timeout ||
+                status == eventloop_post_status::ran_in_caller)
+            {
+                failed_ = true;
+                return false;
+            }
+            return true;
+        }
+
+        void await_resume() const
+        {
+            detail::throw_if_post_failed(failed_, "switch_to: failed to post to the eventloop");
+        }
+    };
+    return awaiter{ loop, false };
+}
+
+/**
+ * @brief Awaitable to suspend the coroutine for a duration, backed by a timer of the event loop.
+ * The coroutine is resumed in the thread which executes the timer task of the event loop.
+ * @note Throw std::runtime_error if the timer task queue is full.
+ *
+ * @param loop the event loop
+ * @param duration the duration to sleep
+ * @return an awaitable object
+ */
+inline auto sleep_for(eventloop& loop, EventloopDuration duration)
+{
+    struct awaiter
+    {
+        eventloop& loop_;
+        EventloopDuration duration_;
+        bool failed_;
+
+        bool await_ready() const { return duration_ <= EventloopDuration::zero(); }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            // 定时任务可能在post_timer_event返回前就已在Loop线程中恢复并销毁协程，
+            // 之后不能再读取handler或awaiter的成员，只根据投递结果(局部变量)判断是否失败
+            auto status = eventloop_post_status::success;
+            loop_.post_timer_event(
+              "co_sleep", [h]() { h.resume(); }, duration_, 1, &status);
+            if (status != eventloop_post_status::success)
+            {
+                failed_ = true;
+                return false;
+            }
+            return true;
+        }
+
+        void await_resume() const
+        {
+            detail::throw_if_post_failed(failed_, "sleep_for: failed to post the timer task");
+        }
+    };
+    return awaiter{ loop, duration, false };
+}
+
+/**
+ * @brief Awaitable to wait until a file descriptor is ready, the fd is watched by the event loop
+ * only once. The coroutine is resumed in the event loop thread.
+ * @note Throw std::runtime_error if the fd can not be watched (see eventloop::add_fd).
+ *
+ * @param loop the event loop
+ * @param fd the file descriptor, which must not be watched by the event loop already
+ * @param events the events to wait for, fd_event_read | fd_event_write
+ * @return an awaitable object, co_await returns the ready events
+ */
+inline auto wait_fd(eventloop& loop, int fd, uint32_t events)
+{
+    struct awaiter
+    {
+        eventloop& loop_;
+        int fd_;
+        uint32_t events_;
+        uint32_t ready_;
+        bool failed_;
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> h)
+        {
+            eventloop* loop = &loop_;
+            uint32_t* ready = &ready_;
+            bool ret = loop_.add_fd(fd_,
+                                    events_,
+                                    [loop, ready, h](int fd, uint32_t events)
+                                    {
+                                        loop->remove_fd(fd);
+                                        *ready = events;
+                                        h.resume();
+                                    });
+            if (!ret)
+            {
+                failed_ = true;
+                return false;
+            }
+            return true;
+        }
+
+        uint32_t await_resume() const
+        {
+            detail::throw_if_post_failed(failed_, "wait_fd: failed to watch the fd");
+            return ready_;
+        }
+    };
+    return awaiter{ loop, fd, events, 0, false };
+}
+
+namespace detail
+{
+
+// when_all的共享状态: 最后一个完成的子任务恢复等待者
+struct when_all_state
+{
+    explicit when_all_state(size_t count)
+      : remaining_(count + 1)
+    {
+    }
+
+    // 子任务完成，返回true表示需要恢复等待者
+    bool arrive() { return remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    std::atomic<size_t> remaining_;
+    std::coroutine_handle<> continuation_;
+    std::mutex mutex_;
+    std::exception_ptr error_;
+};
+
+template<typename T, typename Store>
+detached_task when_all_run(task<T> t, when_all_state& state, Store store)
+{
+    try
+    {
+        if constexpr (std::is_void<T>::value)
+        {
+            co_await std::move(t);
+            store();
+        }
+        else
+        {
+            store(co_await std::move(t));
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(state.mutex_);
+        if (!state.error_)
+        {
+            state.error_ = std::current_exception();
+        }
+    }
+
+    // 先销毁子任务的协程帧，arrive之后等待者可能已经结束
+    t = task<T>();
+    if (state.arrive())
+    {
+        state.continuation_.resume();
+    }
+}
+
+// 等待所有子任务完成(子任务在等待之前启动)
+// 计数比子任务数多1，在设置continuation_之前，最后一个完成的子任务不会去恢复等待者
+struct when_all_awaiter
+{
+    when_all_state& state_;
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> h)
+    {
+        state_.continuation_ = h;
+        // 所有子任务都已完成时不挂起
+        return !state_.arrive();
+    }
+
+    void await_resume() const
+    {
+        if (state_.error_)
+        {
+            std::rethrow_exception(state_.error_);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief Run the tasks concurrently and wait for all of them to complete.
+ * The tasks start in the current thread and each may switch to another event loop, the awaiting
+ * coroutine is resumed in the thread where the last task completes.
+ * @note If some tasks throw exceptions, the first one is rethrown after all tasks complete.
+ *
+ * @tparam T the type of the results
+ * @param tasks the tasks to run
+ * @return task<std::vector<T>> the results in the order of the tasks
+ */
+template<typename T>
+task<std::vector<T>> when_all(std::vector<task<T>> tasks)
+{
+    detail::when_all_state state(tasks.size());
+    std::vector<std::optional<T>> slots(tasks.size());
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+        auto* slot = &slots[i];
+        detail::when_all_run(std::move(tasks[i]),
+                             state,
+                             [slot](T&& value) { slot->emplace(std::move(value)); });
+    }
+    co_await detail::when_all_awaiter{ state };
+
+    std::vector<T> results;
+    results.reserve(slots.size());
+    for (auto& slot : slots)
+    {
+        results.emplace_back(std::move(*slot));
+    }
+    co_return results;
+}
+
+/**
+ * @brief Run the tasks concurrently and wait for all of them to complete.
+ *
+ * @param tasks the tasks to run
+ * @return task<void>
+ */
+inline task<void> when_all(std::vector<task<void>> tasks)
+{
+    detail::when_all_state state(tasks.size());
+    for (auto& t : tasks)
+    {
+        detail::when_all_run(std::move(t), state, []() {});
+    }
+    co_await detail::when_all_awaiter{ state };
+}
+
+/**
+ * @brief Start a task in the thread of the event loop without waiting for it (fire and forget).
+ * @note The coroutine frame is destroyed when the task completes. An exception escaping the task
+ * terminates the program, the same as an exception escaping a thread.
+ *
+ * @param loop the event loop to start the task on
+ * @param t the task
+ */
+inline void co_spawn(eventloop& loop, task<void> t)
+{
+    [](eventloop& loop, task<void> t) -> detail::detached_task
+    {
+        co_await switch_to(loop);
+        co_await std::move(t);
+    }(loop, std::move(t));
+}
+
+/**
+ * @brief Start a task in the calling thread and block until it completes.
+ * @note Do not call it in an event loop thread which the task needs to run on, or it deadlocks.
+ *
+ * @tparam T the type of the result
+ * @param t the task
+ * @return T the result of the task, the exception thrown by the task is rethrown.
+ */
+template<typename T>
+T sync_wait(task<T> t)
+{
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+
+    struct result_slot
+    {
+        std::optional<typename std::conditional<std::is_void<T>::value, char, T>::type> value;
+    } result;
+
+    [](task<T> t,
+       result_slot& result,
+       std::exception_ptr& error,
+       std::mutex& mutex,
+       std::condition_variable& cv,
+       bool& done) -> detail::detached_task
+    {
+        try
+        {
+            if constexpr (std::is_void<T>::value)
+            {
+                co_await std::move(t);
+            }
+            else
+            {
+                result.value.emplace(co_await std::move(t));
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        // 通知调用线程之前销毁任务的协程帧，sync_wait返回后不再有任何访问
+        t = task<T>();
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+        cv.notify_one();
+    }(std::move(t), result, error, mutex, cv, done);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&done]() { return done; });
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    if constexpr (!std::is_void<T>::value)
+    {
+        return std::move(*result.value);
+    }
+}
+
+} // namespace cutl
+
+#endif // CUTL_HAS_COROUTINE
@@ -20,30 +20,190 @@
 
 #pragma once
 
+#include "histogram.h"
+#include "mpmc_queue.h"
+#include "task_function.h"
 #include "threadpool.h"
+#include "threadutil.h"
 #include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <functional>
-#include <list>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace cutl
 {
 
-// 头文件中隐藏TimerTask的定义(非对外接口数据类型)，具体实现在eventloop.cpp中
+// 头文件中隐藏TimerTask和定时任务队列的定义(非对外接口数据类型)，具体实现在inner/timer_queue.h中
 struct TimerTask;
+class timer_queue;
+// 文件描述符监听和IO多路复用器的定义在inner/io_poller.h中
+struct fd_watcher;
+class io_poller;
 using TimerTaskWPtr = std::weak_ptr<TimerTask>;
 using TimerTaskPtr = std::shared_ptr<TimerTask>;
 bool TimerTaskCompare(const TimerTaskPtr& a, const TimerTaskPtr& b);
 // 简化类型声明
 using EventloopDuration = std::chrono::steady_clock::duration;
 using EventloopTimePoint = std::chrono::steady_clock::time_point;
-using EventloopTask = std::function<void()>;
+// 普通任务只执行一次，使用move-only的任务类型，小对象不分配内存
+using EventloopTask = task_function;
+// 定时任务会被执行多次(multithread_eventloop中每次复制一份到线程池中执行)，需要可复制
+using EventloopTimerFunc = std::function<void()>;
+// 文件描述符就绪时的回调，参数为文件描述符和就绪的事件(eventloop_fd_event的组合)
+using EventloopFdFunc = std::function<void(int fd, uint32_t events)>;
+
+/**
+ * @brief The events of a file descriptor watched by the event loop, can be combined by bitwise or.
+ *
+ */
+enum eventloop_fd_event : uint32_t
+{
+    /** The file descriptor is readable */
+    fd_event_read = 0x1,
+    /** The file descriptor is writable */
+    fd_event_write = 0x2,
+    /** An error or hang-up occurred on the file descriptor, it is always reported */
+    fd_event_error = 0x4,
+};
+
+/**
+ * @brief The policy when the task queue of the event loop is full.
+ *
+ */
+enum class eventloop_overflow_policy
+{
+    /** Discard the new task */
+    drop_newest,
+    /**
+     * Discard the oldest task in the queue to make room for the new task. Not suitable for the
+     * coroutine awaitables (coroutine.h), a discarded resume leaves its coroutine suspended forever.
+     */
+    drop_oldest,
+    /** Block the caller until there is room or the timeout expires */
+    block,
+    /** Store the new task in an unbounded overflow queue, no task is discarded */
+    grow,
+    /** Execute the new task in the calling thread */
+    caller_runs,
+};
+
+/**
+ * @brief The result of posting an ordinary task to the event loop.
+ *
+ */
+enum class eventloop_post_status
+{
+    /** The task is queued */
+    success,
+    /** The task is queued, and the oldest task in the queue is discarded (drop_oldest) */
+    dropped_oldest,
+    /** The task is discarded because the queue is full (drop_newest) */
+    rejected,
+    /** The task is discarded because the queue is still full after the timeout (block) */
+    timeout,
+    /** The task has been executed in the calling thread (caller_runs) */
+    ran_in_caller,
+};
+
+// 水位回调，参数为当前队列中的任务数
+using EventloopWatermarkFunc = std::function<void(size_t size)>;
+// 慢处理回调，参数为处理函数的名称(普通任务为"task"，定时任务为任务名，文件描述符为"fd:<fd>")和执行时间
+using EventloopSlowHandlerFunc = std::function<void(const std::string& name, EventloopDuration cost)>;
+
+/**
+ * @brief The runtime statistics of the event loop, the durations are in nanoseconds.
+ * @note The latency histograms are only collected when the statistics is enabled (see
+ * eventloop::set_stats_enabled()). For multithread_eventloop, the tasks are dispatched to the
+ * thread pool, the queue delay and the timer lateness are measured at dispatching, and the
+ * handler time only contains the file descriptor callbacks (see threadpool::stats()).
+ *
+ */
+struct eventloop_stats
+{
+    /** The number of executed (or dispatched) ordinary tasks */
+    uint64_t executed_tasks = 0;
+    /** The number of executed (or dispatched) timer tasks */
+    uint64_t executed_timers = 0;
+    /** The number of handlers which run longer than the slow handler threshold */
+    uint64_t slow_handlers = 0;
+    /** The number of loop iterations */
+    uint64_t iterations = 0;
+    /** The latency from post_event() to starting executing the task */
+    histogram_snapshot queue_delay;
+    /** The execution time of each handler (ordinary task, timer task or fd callback) */
+    histogram_snapshot handler_time;
+    /** The time between the scheduled time and the actual start time of the timer tasks */
+    histogram_snapshot timer_lateness;
+    /**
+     * The busy time of each loop iteration (from waking up to waiting again, including the fd
+     * callbacks, timer tasks and ordinary tasks), which is the longest time a new event may wait
+     * before the loop looks at it
+     */
+    histogram_snapshot loop_lag;
+};
+
+/**
+ * @brief The options of the task queue of the event loop.
+ *
+ */
+struct eventloop_queue_options
+{
+    /** The policy when the task queue is full */
+    eventloop_overflow_policy overflow = eventloop_overflow_policy::drop_newest;
+    /** The max time to block the caller with the block policy */
+    EventloopDuration block_timeout = std::chrono::milliseconds(100);
+    /**
+     * The high watermark of the queue size, 0 means disabled. on_high_watermark is called in the
+     * posting thread once the size reaches it, so that the producers can throttle.
+     */
+    size_t high_watermark = 0;
+    /**
+     * The low watermark of the queue size. on_low_watermark is called in the event loop thread
+     * once the size falls to it after the high watermark has been reached.
+     */
+    size_t low_watermark = 0;
+    /** The callback when the queue size reaches the high watermark */
+    EventloopWatermarkFunc on_high_watermark;
+    /** The callback when the queue size falls to the low watermark */
+    EventloopWatermarkFunc on_low_watermark;
+};
+
+/**
+ * @brief The backend of the timer task queue of the event loop.
+ *
+ */
+enum class eventloop_timer_backend
+{
+    /** Binary heap, O(log n) insertion, exact expiration time */
+    heap,
+    /**
+     * Hierarchical timing wheel, O(1) insertion, the expiration time is rounded up to the tick.
+     * Suitable for a large number of timers, such as connection timeouts.
+     */
+    timing_wheel,
+};
+
+/**
+ * @brief The options of the timer task queue of the event loop.
+ *
+ */
+struct eventloop_timer_options
+{
+    /** The backend of the timer task queue */
+    eventloop_timer_backend backend = eventloop_timer_backend::heap;
+    /** The tick resolution of the timing wheel */
+    EventloopDuration tick = std::chrono::milliseconds(1);
+    /** The number of slots of each level of the timing wheel, rounded up to a power of two */
+    uint32_t wheel_slots = 256;
+    /** The number of levels of the timing wheel, the range is tick * wheel_slots^wheel_levels */
+    uint32_t wheel_levels = 4;
+};
 
 /**
  * Timer task handler. The caller can use this object to cancel timer task.
@@ -85,6 +245,8 @@ public:
 
     /**
      * @brief Cancel the timer task.
+     * The timer task is removed from the timer task queue of its event loop immediately, so that
+     * its memory is reclaimed without waiting for its deadline.
      *
      */
     void cancel();
@@ -108,6 +270,9 @@ private:
  */
 class eventloop
 {
+    // 取消定时任务时，从定时任务队列中移除
+    friend class timer_task_handler;
+
 public:
     using TimerTaskVec = std::vector<TimerTaskPtr>;
 
@@ -130,13 +295,38 @@ public:
 
 public:
     /**
-     * @brief Post ordinary task
+     * @brief Post ordinary task. When the task queue is full, the task is handled by the overflow
+     * policy set by set_queue_options().
      *
-     * @param task task object
-     * @return true
-     * @return false
+     * @param task task object, a small callable object is stored without allocation
+     * @return eventloop_post_status
+     */
+    eventloop_post_status post_event(EventloopTask&& task);
+
+    /**
+     * @brief Set the options of the task queue, such as the overflow policy and the watermarks.
+     * @note It must be called before start().
+     *
+     * @param options the queue options
+     * @return true if success, false if the event loop is running.
+     */
+    bool set_queue_options(const eventloop_queue_options& options);
+
+    /**
+     * @brief Get the total number of the tasks discarded by the overflow policy.
+     *
+     * @return uint64_t
+     */
+    uint64_t dropped_count() const { return dropped_count_.load(); }
+
+    /**
+     * @brief Set the options of the timer task queue.
+     * @note It must be called before any timer task is posted.
+     *
+     * @param options the timer options
+     * @return true if success, false if there are timer tasks in the queue.
      */
-    bool post_event(const EventloopTask& task);
+    bool set_timer_options(const eventloop_timer_options& options);
 
     /**
      * @brief Post timer task
@@ -145,12 +335,95 @@ public:
      * @param func the callback function of timer task
      * @param period the period of timer task
      * @param repeat the repeat times of timer task, -1 means repeat forever
+     * @param status if not null, receives success, or rejected if the timer task queue is full.
+     * Unlike the returned handler, it tells whether the task was queued even if a one-shot task has
+     * already run and been released in the event loop thread.
      * @return timer_task_handler
      */
     timer_task_handler post_timer_event(const std::string& name,
-                                        const EventloopTask& func,
+                                        const EventloopTimerFunc& func,
                                         const EventloopDuration& period,
-                                        int64_t repeat = -1);
+                                        int64_t repeat = -1,
+                                        eventloop_post_status* status = nullptr);
+
+    /**
+     * @brief Get the number of the live timer tasks in the timer task queue.
+     * The canceled timer tasks are removed from the queue and are not counted.
+     *
+     * @return size_t
+     */
+    size_t timer_count() const;
+
+    /**
+     * @brief Watch the events of a file descriptor (level-triggered), the callback is called in
+     * the event loop thread (also for multithread_eventloop) when the file descriptor is ready.
+     * @note Only supported on Linux (epoll) now. The file descriptor should be removed by
+     * remove_fd() before it is closed.
+     *
+     * @param fd the file descriptor, such as a socket, pipe or eventfd
+     * @param events the events to watch, fd_event_read | fd_event_write
+     * @param callback the callback function
+     * @return true if success, false if the fd is already watched or not supported.
+     */
+    bool add_fd(int fd, uint32_t events, const EventloopFdFunc& callback);
+
+    /**
+     * @brief Modify the watched events of a file descriptor.
+     *
+     * @param fd the file descriptor
+     * @param events the events to watch, fd_event_read | fd_event_write
+     * @return true if success, false if the fd is not watched.
+     */
+    bool modify_fd(int fd, uint32_t events);
+
+    /**
+     * @brief Stop watching a file descriptor, the pending events of the fd are discarded.
+     *
+     * @param fd the file descriptor
+     * @return true if success, false if the fd is not watched.
+     */
+    bool remove_fd(int fd);
+
+    /**
+     * @brief Get the total number of the timer tasks canceled by timer_task_handler.
+     *
+     * @return uint64_t
+     */
+    uint64_t cancelled_timer_count() const { return cancelled_timer_count_.load(); }
+
+    /**
+     * @brief Enable or disable collecting the latency statistics, it is enabled by default.
+     * Collecting the latency costs a read of std::chrono::steady_clock when posting a task and two
+     * reads when executing it, the counters are always collected.
+     * @note It must be called before start().
+     *
+     * @param enabled
+     */
+    void set_stats_enabled(bool enabled);
+
+    /**
+     * @brief Set the callback which is called in the event loop thread when a handler (ordinary
+     * task, timer task or fd callback) runs longer than the threshold.
+     * @note It must be called before start(), and it works only when the statistics is enabled.
+     *
+     * @param threshold the threshold of the execution time, zero means disabled
+     * @param callback the callback with the name and the execution time of the handler
+     */
+    void set_slow_handler_callback(EventloopDuration threshold,
+                                   const EventloopSlowHandlerFunc& callback);
+
+    /**
+     * @brief Get the runtime statistics of the event loop.
+     *
+     * @return eventloop_stats
+     */
+    eventloop_stats stats() const;
+
+    /**
+     * @brief Reset the latency histograms and the counters of the statistics.
+     *
+     */
+    void reset_stats();
 
     /**
      * @brief 运行EventLoopBase，如果满足运行条件该接口会阻塞直到Stop被调用
@@ -185,24 +458,64 @@ public:
      */
     bool is_loop_thread() const;
 
+    /**
+     * @brief Get the number of the ordinary tasks waiting in the task queue (approximate).
+     *
+     * @return size_t
+     */
+    size_t task_count() const { return task_queue_.size() + overflow_size_.load(); }
+
+protected:
+    // 队列中的普通任务，附带投递时间用于统计排队时延
+    struct queued_task
+    {
+        EventloopTask task;
+        EventloopTimePoint post_time;
+    };
+
 private:
-    // 唤醒Loop线程
+    // 无条件唤醒Loop线程
     void wakeup();
+    // 仅在Loop线程等待(或即将等待)时唤醒，Loop线程忙碌时不需要唤醒
+    void wakeup_if_sleeping();
+    // 通知阻塞在IO多路复用器或条件变量上的Loop线程
+    void notify_loop();
     // 等待超时或者被唤醒
     void wait_for_timeout_or_wakeup(std::chrono::microseconds timeout);
     // 执行单次循序的任务
     void loop_once(EventloopDuration default_timeout);
+    // 从定时任务队列中移除已取消的定时任务
+    void cancel_timer_task(TimerTask* task);
+    // 等待IO事件、超时或者被唤醒，并执行就绪的文件描述符的回调
+    size_t wait_for_io_events(EventloopDuration timeout);
+    // 队列已满时按溢出策略处理任务
+    eventloop_post_status post_overflow(queued_task& item);
+    // 阻塞等待队列中有空位，直到超时
+    bool push_blocking(queued_task& item);
+    // 记录被丢弃的任务
+    void record_dropped();
+    // 队列中的任务被取出后: 唤醒阻塞的生产者，检查低水位
+    void on_tasks_consumed();
 
 protected:
     // 处理任务
     virtual size_t handle_task();
+    // 取出下一个普通任务(先取环形队列，再取溢出队列)
+    bool pop_task(queued_task& item);
+    // 一次取出本轮要处理的普通任务，放入task_batch_
+    size_t drain_tasks();
     // 执行到点的定时任务
     virtual size_t handle_timer_task();
-    // 开始事件循环
+    // 开始事件循环，调用前需要将is_running_置为true
     void start_loop();
+    // 获取任务的投递时间，未开启统计时不读取时钟
+    EventloopTimePoint post_time() const;
+    // 记录处理函数的执行时间，超过阈值时调用慢处理回调；name_func只在慢处理时调用，避免构造字符串
+    template<typename NameFunc>
+    void record_handler(EventloopTimePoint start, const NameFunc& name_func);
     // 添加定时任务
     timer_task_handler post_to_priorityqueue(const std::string& name,
-                                             const EventloopTask& func,
+                                             const EventloopTimerFunc& func,
                                              const EventloopDuration& period,
                                              int repeat);
     // 从定时任务队列中获取离当前时间最近的定时任务的到期间隔
@@ -215,18 +528,55 @@ protected:
     // 事件循环是否运行中
     std::atomic<bool> is_running_;
     // 事件循环的线程id
-    std::thread::id loop_thread_id_;
-    // 普通任务 队列， 特点：单次执行，先进先出
-    std::mutex task_mutex_;
-    std::list<EventloopTask> task_queue_;
+    std::atomic<std::thread::id> loop_thread_id_;
+    // Loop线程是否正在(或即将)等待，为false时投递任务不需要唤醒
+    std::atomic<bool> sleeping_;
+    // 普通任务 队列(无锁的有界队列)， 特点：单次执行，先进先出
+    mpmc_queue<queued_task> task_queue_;
     uint32_t task_max_size_;
-    // 定时任务 优先队列， 特点：循环执行，时间优先
-    std::mutex timer_task_mutex_;
-    std::priority_queue<TimerTaskPtr, TimerTaskVec, decltype(&TimerTaskCompare)> timer_task_queue_;
+    // 本轮批量取出的普通任务，只在Loop线程中使用，复用内存
+    std::vector<queued_task> task_batch_;
+    // 普通任务队列的溢出策略和水位
+    eventloop_queue_options queue_options_;
+    std::atomic<uint64_t> dropped_count_;
+    std::atomic<bool> above_high_watermark_;
+    // grow策略的溢出队列，不为空时新任务也放入溢出队列，保证先进先出
+    std::mutex overflow_mutex_;
+    std::deque<queued_task> overflow_queue_;
+    std::atomic<size_t> overflow_size_;
+    // block策略: 等待队列空位的生产者
+    std::mutex space_mutex_;
+    std::condition_variable space_cv_;
+    std::atomic<uint32_t> blocked_producers_;
+    // 定时任务 队列(最小堆或时间轮)， 特点：循环执行，时间优先
+    mutable std::mutex timer_task_mutex_;
+    std::unique_ptr<timer_queue> timer_task_queue_;
     uint32_t timer_task_max_size_;
+    // 被取消的定时任务个数
+    std::atomic<uint64_t> cancelled_timer_count_;
+    // IO多路复用器(Linux下为epoll)，为空时使用条件变量等待
+    std::unique_ptr<io_poller> io_poller_;
+    // 监听的文件描述符
+    std::mutex fd_mutex_;
+    std::unordered_map<int, std::shared_ptr<fd_watcher>> fd_watchers_;
+    uint32_t fd_watcher_id_;
     // 唤醒Loop线程的条件变量
     std::mutex cv_mutex_;
     std::condition_variable cv_wakeup_;
+    // 运行时统计，计数和直方图只在Loop线程中写入
+    bool stats_enabled_;
+    EventloopDuration slow_threshold_;
+    EventloopSlowHandlerFunc on_slow_handler_;
+    std::atomic<uint64_t> executed_tasks_;
+    std::atomic<uint64_t> executed_timers_;
+    std::atomic<uint64_t> slow_handlers_;
+    std::atomic<uint64_t> iterations_;
+    latency_histogram queue_delay_;
+    latency_histogram handler_time_;
+    latency_histogram timer_lateness_;
+    latency_histogram loop_lag_;
+    // 本轮Loop线程醒来的时间(epoll_wait或条件变量等待返回时)，用于统计loop_lag_
+    EventloopTimePoint wake_time_;
 };
 
 /**
@@ -243,6 +593,16 @@ public:
     ~singlethread_eventloop() = default;
 
 public:
+    /**
+     * @brief Set the CPU placement policy of the event loop thread, the thread is placed as the
+     * index-th thread of the policy.
+     * @note It must be called before start().
+     *
+     * @param placement the placement policy
+     * @param index the index of the thread in the placement policy
+     */
+    void set_placement(const thread_placement& placement, uint32_t index = 0);
+
     /**
      * @brief Start to run the event loop.
      * @note If the running conditions are satisfied, this interface will block until Stop is
@@ -259,6 +619,9 @@ public:
 private:
     std::thread loop_thread_;
     std::string thread_name_;
+    // 事件循环线程的CPU绑定策略
+    thread_placement placement_;
+    uint32_t placement_index_ = 0;
 };
 
 /**
@@ -307,4 +670,157 @@ private:
     threadpool thread_pool_;
 };
 
+/**
+ * @brief The policy to choose an event loop of the eventloop_group.
+ *
+ */
+enum class eventloop_balance
+{
+    /** Choose the event loops in turn */
+    round_robin,
+    /** Choose the event loop with the fewest waiting tasks */
+    least_loaded,
+};
+
+/**
+ * @brief A group of single thread event loops (one loop per thread, the multi-reactor model).
+ * Each event loop has its own thread, task queue and timer task queue, so the loops do not contend
+ * with each other. The tasks posted with the same key always run on the same loop in order, such as
+ * the events of the same session.
+ *
+ */
+class eventloop_group
+{
+public:
+    /**
+     * @brief Construct a new eventloop group object
+     *
+     * @param name the name of the group, the thread of the i-th loop is named "name-i"
+     * @param loop_num the number of event loops, 0 means the number of hardware threads
+     * @param task_max_size the max size of task queue of each loop
+     * @param timer_task_max_size the max size of timer task queue of each loop
+     */
+    eventloop_group(const std::string& name,
+                    uint32_t loop_num = 0,
+                    uint32_t task_max_size = 20,
+                    uint32_t timer_task_max_size = 10);
+    /**
+     * @brief Destroy the eventloop group object, all the event loops are stopped.
+     *
+     */
+    ~eventloop_group();
+
+    // 不可以复制
+    eventloop_group(const eventloop_group&) = delete;
+    eventloop_group& operator=(const eventloop_group&) = delete;
+
+public:
+    /**
+     * @brief Set the CPU placement policy of the threads, the thread of the i-th loop is placed as
+     * the i-th thread of the policy.
+     * @note It must be called before start().
+     *
+     * @param placement the placement policy
+     */
+    void set_placement(const thread_placement& placement);
+
+    /**
+     * @brief Start all the event loops, each in its own thread.
+     *
+     */
+    void start();
+
+    /**
+     * @brief Stop all the event loops and wait for the threads to exit.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Get the number of event loops.
+     *
+     * @return uint32_t
+     */
+    uint32_t size() const { return static_cast<uint32_t>(loops_.size()); }
+
+    /**
+     * @brief Get the index-th event loop.
+     *
+     * @param index the index of the event loop, in [0, size())
+     * @return singlethread_eventloop&
+     */
+    singlethread_eventloop& loop(uint32_t index) { return *loops_[index]; }
+
+    /**
+     * @brief Choose an event loop by the policy.
+     *
+     * @param policy the policy to choose the event loop
+     * @return singlethread_eventloop&
+     */
+    singlethread_eventloop& next_loop(eventloop_balance policy = eventloop_balance::round_robin);
+
+    /**
+     * @brief Get the event loop of the key, the same key always maps to the same loop.
+     *
+     * @tparam Key the type of the key, which is hashable by std::hash
+     * @param key the key, such as the session id
+     * @return singlethread_eventloop&
+     */
+    template<typename Key>
+    singlethread_eventloop& loop_for_key(const Key& key)
+    {
+        return *loops_[hash_to_index(std::hash<Key>()(key))];
+    }
+
+    /**
+     * @brief Post ordinary task to an event loop chosen by the policy.
+     *
+     * @param task task object
+     * @param policy the policy to choose the event loop
+     * @return eventloop_post_status
+     */
+    eventloop_post_status post_event(EventloopTask&& task,
+                                     eventloop_balance policy = eventloop_balance::round_robin);
+
+    /**
+     * @brief Post ordinary task to the event loop of the key, the tasks with the same key are
+     * executed in order in the same thread.
+     *
+     * @tparam Key the type of the key, which is hashable by std::hash
+     * @param key the key, such as the session id
+     * @param task task object
+     * @return eventloop_post_status
+     */
+    template<typename Key>
+    eventloop_post_status post_event_by_key(const Key& key, EventloopTask&& task)
+    {
+        return loop_for_key(key).post_event(std::move(task));
+    }
+
+    /**
+     * @brief Post timer task to an event loop chosen in turn.
+     *
+     * @param name the name of timer task
+     * @param func the callback function of timer task
+     * @param period the period of timer task
+     * @param repeat the repeat times of timer task, -1 means repeat forever
+     * @param status if not null, receives success, or rejected if the timer task queue is full
+     * @return timer_task_handler
+     */
+    timer_task_handler post_timer_event(const std::string& name,
+                                        const EventloopTimerFunc& func,
+                                        const EventloopDuration& period,
+                                        int64_t repeat = -1,
+                                        eventloop_post_status* status = nullptr);
+
+private:
+    // 将哈希值映射到事件循环的序号
+    uint32_t hash_to_index(size_t hash) const;
+
+private:
+    std::vector<std::unique_ptr<singlethread_eventloop>> loops_;
+    // 轮询的下一个序号
+    std::atomic<uint32_t> next_index_;
+};
+
 } // namespace cutl
\ No newline at end of file
@@ -0,0 +1,216 @@
+/**
+ * @copyright Copyright (c) 2025, Spencer.Luo. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the
+ * License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing permissions and
+ * limitations.
+ *
+ * @file histogram.h
+ * @brief Lock-free latency histogram with power-of-two buckets, used for runtime statistics.
+ * @author Spencer
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace cutl
+{
+
+/**
+ * @brief The number of buckets of the latency histogram.
+ * Bucket 0 counts the values in [0, 2)ns, and bucket i (i > 0) counts the values in [2^i,
+ * 2^(i+1))ns, the last bucket also counts all the larger values (more than 18 minutes).
+ *
+ */
+static constexpr size_t histogram_bucket_count = 40;
+
+/**
+ * @brief A snapshot of a latency_histogram, all the values are in nanoseconds.
+ *
+ */
+struct histogram_snapshot
+{
+    /** The number of the recorded values */
+    uint64_t count = 0;
+    /** The sum of the recorded values */
+    uint64_t sum = 0;
+    /** The maximum recorded value */
+    uint64_t max = 0;
+    /** The count of each bucket */
+    std::array<uint64_t, histogram_bucket_count> buckets{};
+
+    /**
+     * @brief Get the mean of the recorded values.
+     *
+     * @return double the mean value, 0 if there is no recorded value.
+     */
+    double mean() const { return count == 0 ? 0.0 : static_cast<double>(sum) / count; }
+
+    /**
+     * @brief Get the approximate percentile of the recorded values.
+     * The result is the upper bound of the bucket which the percentile falls in, and not greater
+     * than the maximum recorded value.
+     *
+     * @param p the percentile in [0, 100], such as 50, 99, 99.9
+     * @return uint64_t the percentile value, 0 if there is no recorded value.
+     */
+    uint64_t percentile(double p) const
+    {
+        if (count == 0)
+        {
+            return 0;
+        }
+        auto rank = static_cast<uint64_t>(static_cast<double>(count) * p / 100.0);
+        rank = rank == 0 ? 1 : rank;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < histogram_bucket_count; i++)
+        {
+            seen += buckets[i];
+            if (seen >= rank)
+            {
+                uint64_t upper = (static_cast<uint64_t>(1) << (i + 1)) - 1;
+                return upper < max ? upper : max;
+            }
+        }
+        return max;
+    }
+
+    /**
+     * @brief Merge another snapshot into this one.
+     *
+     * @param other the other snapshot
+     */
+    void merge(const histogram_snapshot& other)
+    {
+        count += other.count;
+        sum += other.sum;
+        max = other.max > max ? other.max : max;
+        for (size_t i = 0; i < histogram_bucket_count; i++)
+        {
+            buckets[i] += other.buckets[i];
+        }
+    }
+};
+
+/**
+ * @brief A lock-free histogram of latencies with power-of-two buckets.
+ * record() only takes a few relaxed atomic operations, and is cheapest when each thread records to
+ * its own histogram (no cache line contention). The snapshots of several histograms can be merged
+ * by histogram_snapshot::merge().
+ *
+ */
+class latency_histogram
+{
+public:
+    latency_histogram() { reset(); }
+
+    // 不可以复制
+    latency_histogram(const latency_histogram&) = delete;
+    latency_histogram& operator=(const latency_histogram&) = delete;
+
+    /**
+     * @brief Record a value in nanoseconds.
+     *
+     * @param ns the value
+     */
+    void record(uint64_t ns)
+    {
+        buckets_[bucket_index(ns)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(ns, std::memory_order_relaxed);
+        uint64_t cur = max_.load(std::memory_order_relaxed);
+        while (ns > cur && !max_.compare_exchange_weak(cur, ns, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /**
+     * @brief Record a duration.
+     *
+     * @tparam Rep
+     * @tparam Period
+     * @param d the duration, the negative duration is recorded as 0
+     */
+    template<typename Rep, typename Period>
+    void record(const std::chrono::duration<Rep, Period>& d)
+    {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        record(static_cast<uint64_t>(ns > 0 ? ns : 0));
+    }
+
+    /**
+     * @brief Get a snapshot of the histogram.
+     * @note The snapshot is not atomic as a whole when other threads are recording.
+     *
+     * @return histogram_snapshot
+     */
+    histogram_snapshot snapshot() const
+    {
+        histogram_snapshot snap;
+        snap.count = count_.load(std::memory_order_relaxed);
+        snap.sum = sum_.load(std::memory_order_relaxed);
+        snap.max = max_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < histogram_bucket_count; i++)
+        {
+            snap.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        return snap;
+    }
+
+    /**
+     * @brief Reset all the counters to 0.
+     *
+     */
+    void reset()
+    {
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+        for (auto& bucket : buckets_)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    // 值的二进制最高位的位置即为桶的序号
+    static size_t bucket_index(uint64_t ns)
+    {
+        if (ns < 2)
+        {
+            return 0;
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        size_t index = static_cast<size_t>(63 - __builtin_clzll(ns));
+#else
+        size_t index = 0;
+        while (ns > 1)
+        {
+            ns >>= 1;
+            index++;
+        }
+#endif
+        return index < histogram_bucket_count ? index : histogram_bucket_count - 1;
+    }
+
+private:
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+    std::atomic<uint64_t> max_;
+    std::array<std::atomic<uint64_t>, histogram_bucket_count> buckets_;
+};
+
+} // namespace cutl
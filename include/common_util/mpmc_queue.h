@@ -0,0 +1,294 @@
+/**
+ * @copyright Copyright (c) 2025, Spencer.Luo. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the
+ * License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing permissions and
+ * limitations.
+ *
+ * @file mpmc_queue.h
+ * @brief Lock-free bounded multi-producer multi-consumer queue
+ * @author Spencer
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cutl
+{
+
+/**
+ * @brief A lock-free bounded multi-producer multi-consumer queue based on a ring buffer.
+ * The storage of all elements is allocated once in the constructor, push and pop do not allocate
+ * any memory and do not take any lock.
+ * @note The queue does not block, try_push() returns false when the queue is full and try_pop()
+ * returns false when the queue is empty. The caller decides how to wait.
+ *
+ * @tparam T The type of the element, it must be move constructible.
+ */
+template<typename T>
+class mpmc_queue
+{
+private:
+    static constexpr size_t cache_line_size = 64;
+
+    // 环形缓冲区的槽位，sequence_标记槽位的状态：
+    // sequence_ == pos: 槽位空闲，可以写入第pos个元素
+    // sequence_ == pos + 1: 槽位已写入第pos个元素，可以读取
+    struct cell
+    {
+        std::atomic<size_t> sequence_;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+    };
+
+public:
+    /**
+     * @brief Construct a new mpmc_queue object
+     *
+     * @param capacity The maximum number of elements in the queue, at least 1.
+     */
+    explicit mpmc_queue(size_t capacity)
+      : capacity_(capacity == 0 ? 1 : capacity)
+      , buffer_(new cell[capacity_])
+      , enqueue_pos_(0)
+      , dequeue_pos_(0)
+    {
+        for (size_t i = 0; i < capacity_; i++)
+        {
+            buffer_[i].sequence_.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Destroy the mpmc_queue object, all the remaining elements are destroyed.
+     *
+     */
+    ~mpmc_queue()
+    {
+        size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t tail = enqueue_pos_.load(std::memory_order_relaxed);
+        for (size_t pos = head; pos != tail; pos++)
+        {
+            reinterpret_cast<T*>(&buffer_[pos % capacity_].storage_)->~T();
+        }
+    }
+
+    // 不可以复制
+    mpmc_queue(const mpmc_queue&) = delete;
+    mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+    /**
+     * @brief Push an element into the queue.
+     *
+     * @param item the element to push
+     * @return true if success, false if the queue is full.
+     */
+    bool try_push(const T& item) { return try_emplace(item); }
+
+    /**
+     * @brief Push an element into the queue by moving.
+     * @note The item is only moved from when the push succeeds.
+     *
+     * @param item the element to push
+     * @return true if success, false if the queue is full.
+     */
+    bool try_push(T&& item) { return try_emplace(std::move(item)); }
+
+    /**
+     * @brief Construct an element in place at the tail of the queue.
+     *
+     * @param args the arguments to construct the element
+     * @return true if success, false if the queue is full.
+     */
+    template<typename... Args>
+    bool try_emplace(Args&&... args)
+    {
+        cell* c = nullptr;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            c = &buffer_[pos % capacity_];
+            size_t seq = c->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                // 槽位空闲，抢占写入位置
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // 槽位中的元素还未被读取，队列已满
+                return false;
+            }
+            else
+            {
+                // 其他生产者已经抢占了该位置，重新获取写入位置
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        new (&c->storage_) T(std::forward<Args>(args)...);
+        c->sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Pop an element from the head of the queue.
+     *
+     * @param item the popped element
+     * @return true if success, false if the queue is empty.
+     */
+    bool try_pop(T& item)
+    {
+        cell* c = nullptr;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            c = &buffer_[pos % capacity_];
+            size_t seq = c->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                // 槽位已写入，抢占读取位置
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                // 槽位还未被写入，队列为空
+                return false;
+            }
+            else
+            {
+                // 其他消费者已经抢占了该位置，重新获取读取位置
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        T* p = reinterpret_cast<T*>(&c->storage_);
+        item = std::move(*p);
+        p->~T();
+        // 槽位进入下一轮(pos + capacity_)的写入
+        c->sequence_.store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Pop at most max_count elements from the head of the queue at once.
+     * The consecutive ready elements are claimed by a single CAS, which is cheaper than calling
+     * try_pop() for each element when a consumer drains the queue in batches.
+     *
+     * @tparam OutputIt the output iterator type, such as std::back_insert_iterator
+     * @param out the output iterator to receive the popped elements in FIFO order
+     * @param max_count the max number of elements to pop
+     * @return size_t the number of popped elements, 0 if the queue is empty.
+     */
+    template<typename OutputIt>
+    size_t try_pop_bulk(OutputIt out, size_t max_count)
+    {
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (true)
+        {
+            // 统计从pos开始连续已写入的槽位
+            count = 0;
+            while (count < max_count && count < capacity_)
+            {
+                const cell& c = buffer_[(pos + count) % capacity_];
+                if (c.sequence_.load(std::memory_order_acquire) != pos + count + 1)
+                {
+                    break;
+                }
+                count++;
+            }
+            if (count == 0)
+            {
+                size_t head = dequeue_pos_.load(std::memory_order_relaxed);
+                if (head == pos)
+                {
+                    // 队列为空
+                    return 0;
+                }
+                // 其他消费者已经取走了元素，从新的位置重新统计
+                pos = head;
+                continue;
+            }
+            // 一次抢占连续的count个读取位置，失败时pos被更新为最新的读取位置
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            cell& c = buffer_[(pos + i) % capacity_];
+            T* p = reinterpret_cast<T*>(&c.storage_);
+            *out = std::move(*p);
+            ++out;
+            p->~T();
+            c.sequence_.store(pos + i + capacity_, std::memory_order_release);
+        }
+        return count;
+    }
+
+    /**
+     * @brief Get the number of elements in the queue.
+     * @note The value is only a snapshot when other threads are pushing or popping.
+     *
+     * @return size_t
+     */
+    size_t size() const
+    {
+        size_t tail = enqueue_pos_.load(std::memory_order_acquire);
+        size_t head = dequeue_pos_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    /**
+     * @brief Whether the queue is empty or not.
+     * @note The value is only a snapshot when other threads are pushing or popping.
+     *
+     * @return true
+     * @return false
+     */
+    bool empty() const { return size() == 0; }
+
+    /**
+     * @brief Get the capacity of the queue.
+     *
+     * @return size_t
+     */
+    size_t capacity() const { return capacity_; }
+
+private:
+    const size_t capacity_;
+    std::unique_ptr<cell[]> buffer_;
+    // 生产者和消费者的位置分别独占一个缓存行，避免伪共享
+    char pad0_[cache_line_size];
+    std::atomic<size_t> enqueue_pos_;
+    char pad1_[cache_line_size - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> dequeue_pos_;
+    char pad2_[cache_line_size - sizeof(std::atomic<size_t>)];
+};
+
+} // namespace cutl
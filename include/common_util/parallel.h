@@ -0,0 +1,381 @@
+/**
+ * @copyright Copyright (c) 2025, Spencer.Luo. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the
+ * License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing permissions and
+ * limitations.
+ *
+ * @file parallel.h
+ * @brief Parallel algorithms running on a cutl::threadpool, such as parallel_for,
+ * parallel_reduce, parallel_transform and parallel_sort.
+ * @author Spencer
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace cutl
+{
+
+namespace detail
+{
+
+// 自动分块时，每个工作线程平均分到的块数，块数多于线程数可以平衡各块耗时不均的情况
+static constexpr size_t parallel_chunks_per_thread = 4;
+
+// 计算每个块的元素个数: grain为0时根据线程池的线程数自动分块
+inline size_t parallel_chunk_size(const threadpool& pool, size_t size, size_t grain)
+{
+    if (grain > 0)
+    {
+        return grain;
+    }
+    size_t threads = std::max<size_t>(pool.thread_count(), 1) + 1;
+    size_t chunk = size / (threads * parallel_chunks_per_thread);
+    return std::max<size_t>(chunk, 1);
+}
+
+// 并行执行chunk_count个块，调用线程也参与执行，所有块执行完后返回
+// chunk_func的参数为块的序号[0, chunk_count)，块内抛出的第一个异常会在调用线程中重新抛出
+template<typename ChunkFunc>
+void parallel_run(threadpool& pool, size_t chunk_count, const ChunkFunc& chunk_func)
+{
+    if (chunk_count == 0)
+    {
+        return;
+    }
+    if (chunk_count == 1)
+    {
+        chunk_func(0);
+        return;
+    }
+
+    struct run_state
+    {
+        std::atomic<size_t> next{ 0 };
+        std::atomic<size_t> done{ 0 };
+        std::mutex mutex;
+        std::condition_variable cv_done;
+        std::exception_ptr error;
+    };
+    auto state = std::make_shared<run_state>();
+
+    // 每个执行者不断领取下一个未执行的块，直到所有块都被领取
+    // 只有领取到块时才会访问chunk_func，而调用线程会等待所有块执行完，所以chunk_func不会失效
+    auto runner = [state, chunk_count, &chunk_func]()
+    {
+        size_t index = 0;
+        while ((index = state->next.fetch_add(1)) < chunk_count)
+        {
+            try
+            {
+                chunk_func(index);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->error)
+                {
+                    state->error = std::current_exception();
+                }
+            }
+
+            if (state->done.fetch_add(1) + 1 == chunk_count)
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->cv_done.notify_all();
+            }
+        }
+    };
+
+    // 线程池中的协助者，调用线程自己也是一个执行者
+    size_t helpers = std::min<size_t>(pool.thread_count(), chunk_count - 1);
+    if (helpers > 0)
+    {
+        std::vector<threadpool::Task> tasks;
+        tasks.reserve(helpers);
+        for (size_t i = 0; i < helpers; i++)
+        {
+            tasks.emplace_back(runner);
+        }
+        // 不能阻塞: 在工作线程中嵌套调用且队列已满时，所有工作线程都会等待队列空位而死锁
+        // 放不下的协助者直接丢弃，未被领取的块由调用线程自己执行
+        pool.try_add_tasks(std::move(tasks));
+    }
+
+    // 调用线程参与执行，而不是阻塞等待
+    runner();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv_done.wait(lock, [&state, chunk_count]() { return state->done.load() == chunk_count; });
+    if (state->error)
+    {
+        std::rethrow_exception(state->error);
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Execute fn(i) for each i in [begin, end) in parallel on the threadpool.
+ * The range is divided into chunks of grain elements, and the calling thread also executes the
+ * chunks instead of blocking.
+ * @note If fn throws an exception, the first exception is rethrown in the calling thread after all
+ * chunks are finished.
+ *
+ * @tparam Index integral type of the index
+ * @tparam Func the type of the function, void(Index)
+ * @param pool the threadpool to run on
+ * @param begin the first index
+ * @param end the end of the index
+ * @param grain the number of elements of each chunk, 0 means chunking automatically
+ * @param fn the function to execute for each index
+ */
+template<typename Index, typename Func>
+void parallel_for(threadpool& pool, Index begin, Index end, Index grain, Func fn)
+{
+    if (end <= begin)
+    {
+        return;
+    }
+
+    size_t size = static_cast<size_t>(end - begin);
+    size_t chunk = detail::parallel_chunk_size(pool, size, static_cast<size_t>(grain));
+    size_t chunk_count = (size + chunk - 1) / chunk;
+    detail::parallel_run(pool,
+                         chunk_count,
+                         [begin, size, chunk, &fn](size_t index)
+                         {
+                             size_t first = index * chunk;
+                             size_t last = std::min(first + chunk, size);
+                             for (size_t i = first; i < last; i++)
+                             {
+                                 fn(static_cast<Index>(begin + static_cast<Index>(i)));
+                             }
+                         });
+}
+
+/**
+ * @brief Execute fn(i) for each i in [begin, end) in parallel on the threadpool, the range is
+ * divided into chunks automatically.
+ *
+ * @tparam Index integral type of the index
+ * @tparam Func the type of the function, void(Index)
+ * @param pool the threadpool to run on
+ * @param begin the first index
+ * @param end the end of the index
+ * @param fn the function to execute for each index
+ */
+template<typename Index, typename Func>
+void parallel_for(threadpool& pool, Index begin, Index end, Func fn)
+{
+    parallel_for(pool, begin, end, static_cast<Index>(0), std::move(fn));
+}
+
+/**
+ * @brief Reduce the elements in [first, last) in parallel on the threadpool.
+ * Each chunk is reduced starting from its first element (converted to T), then the results of the
+ * chunks are combined with init in order by the same op.
+ * @note op must be associative, otherwise the result is not the same as std::accumulate. Since op
+ * also combines the results of the chunks, it is called as T(T, T), and the value_type of RandomIt
+ * must be convertible to T. To reduce elements of another type (e.g. the total length of strings),
+ * map them to T with parallel_transform first.
+ *
+ * @tparam RandomIt random access iterator
+ * @tparam T the type of the result
+ * @tparam BinaryOp the type of the reduce function, T(T, T)
+ * @param pool the threadpool to run on
+ * @param first the first element
+ * @param last the end of the elements
+ * @param init the initial value
+ * @param op the reduce function
+ * @param grain the number of elements of each chunk, 0 means chunking automatically
+ * @return T the result of the reduction
+ */
+template<typename RandomIt, typename T, typename BinaryOp>
+T parallel_reduce(threadpool& pool,
+                  RandomIt first,
+                  RandomIt last,
+                  T init,
+                  BinaryOp op,
+                  size_t grain = 0)
+{
+    if (last <= first)
+    {
+        return init;
+    }
+
+    size_t size = static_cast<size_t>(last - first);
+    size_t chunk = detail::parallel_chunk_size(pool, size, grain);
+    size_t chunk_count = (size + chunk - 1) / chunk;
+    std::vector<T> partial(chunk_count, init);
+    detail::parallel_run(pool,
+                         chunk_count,
+                         [first, size, chunk, &op, &partial](size_t index)
+                         {
+                             auto begin = first + index * chunk;
+                             auto end = first + std::min((index + 1) * chunk, size);
+                             // 每个块以块内的第一个元素作为初始值，init只参与一次计算
+                             T value = static_cast<T>(*begin);
+                             for (auto it = begin + 1; it != end; ++it)
+                             {
+                                 value = op(value, *it);
+                             }
+                             partial[index] = std::move(value);
+                         });
+
+    T result = std::move(init);
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+        result = op(result, partial[i]);
+    }
+    return result;
+}
+
+/**
+ * @brief Apply unary_op to each element in [first, last) in parallel, and store the results to
+ * the range beginning at d_first.
+ *
+ * @tparam RandomIt random access iterator of the input
+ * @tparam OutputIt random access iterator of the output
+ * @tparam UnaryOp the type of the function
+ * @param pool the threadpool to run on
+ * @param first the first element
+ * @param last the end of the elements
+ * @param d_first the beginning of the output range
+ * @param unary_op the transform function
+ * @param grain the number of elements of each chunk, 0 means chunking automatically
+ * @return OutputIt iterator to the element past the last element transformed
+ */
+template<typename RandomIt, typename OutputIt, typename UnaryOp>
+OutputIt parallel_transform(threadpool& pool,
+                            RandomIt first,
+                            RandomIt last,
+                            OutputIt d_first,
+                            UnaryOp unary_op,
+                            size_t grain = 0)
+{
+    if (last <= first)
+    {
+        return d_first;
+    }
+
+    size_t size = static_cast<size_t>(last - first);
+    size_t chunk = detail::parallel_chunk_size(pool, size, grain);
+    size_t chunk_count = (size + chunk - 1) / chunk;
+    detail::parallel_run(pool,
+                         chunk_count,
+                         [first, d_first, size, chunk, &unary_op](size_t index)
+                         {
+                             size_t offset = index * chunk;
+                             auto begin = first + offset;
+                             auto end = first + std::min(offset + chunk, size);
+                             std::transform(begin, end, d_first + offset, unary_op);
+                         });
+    return d_first + size;
+}
+
+/**
+ * @brief Sort the elements in [first, last) in parallel with a merge sort.
+ * The range is divided into chunks which are sorted by std::sort in parallel, then the adjacent
+ * sorted chunks are merged in parallel round by round.
+ * @note The sort is not stable.
+ *
+ * @tparam RandomIt random access iterator
+ * @tparam Compare the type of the comparison function
+ * @param pool the threadpool to run on
+ * @param first the first element
+ * @param last the end of the elements
+ * @param comp the comparison function
+ * @param grain the minimum number of elements of each chunk, 0 means chunking automatically
+ */
+template<typename RandomIt, typename Compare>
+void parallel_sort(threadpool& pool, RandomIt first, RandomIt last, Compare comp, size_t grain = 0)
+{
+    // 元素太少时，并行排序的调度开销大于收益
+    static constexpr size_t min_parallel_size = 4096;
+
+    if (last - first < 2)
+    {
+        return;
+    }
+
+    size_t size = static_cast<size_t>(last - first);
+    if (grain == 0 && size < min_parallel_size)
+    {
+        std::sort(first, last, comp);
+        return;
+    }
+
+    // 自动分块时，块数为线程数(含调用线程)，避免归并的轮数过多
+    size_t chunk = grain;
+    if (chunk == 0)
+    {
+        size_t threads = std::max<size_t>(pool.thread_count(), 1) + 1;
+        chunk = std::max<size_t>((size + threads - 1) / threads, min_parallel_size / 4);
+    }
+    size_t chunk_count = (size + chunk - 1) / chunk;
+
+    // 各块并行排序
+    detail::parallel_run(pool,
+                         chunk_count,
+                         [first, size, chunk, &comp](size_t index)
+                         {
+                             auto begin = first + index * chunk;
+                             auto end = first + std::min((index + 1) * chunk, size);
+                             std::sort(begin, end, comp);
+                         });
+
+    // 相邻的有序块两两归并，每轮归并后有序块的长度翻倍
+    for (size_t width = chunk; width < size; width *= 2)
+    {
+        size_t merge_count = (size + 2 * width - 1) / (2 * width);
+        detail::parallel_run(pool,
+                             merge_count,
+                             [first, size, width, &comp](size_t index)
+                             {
+                                 size_t lo = index * 2 * width;
+                                 size_t mid = std::min(lo + width, size);
+                                 size_t hi = std::min(lo + 2 * width, size);
+                                 if (mid < hi)
+                                 {
+                                     std::inplace_merge(first + lo, first + mid, first + hi, comp);
+                                 }
+                             });
+    }
+}
+
+/**
+ * @brief Sort the elements in [first, last) in ascending order in parallel with a merge sort.
+ *
+ * @tparam RandomIt random access iterator
+ * @param pool the threadpool to run on
+ * @param first the first element
+ * @param last the end of the elements
+ */
+template<typename RandomIt>
+void parallel_sort(threadpool& pool, RandomIt first, RandomIt last)
+{
+    using value_type = typename std::iterator_traits<RandomIt>::value_type;
+    parallel_sort(pool, first, last, std::less<value_type>());
+}
+
+} // namespace cutl
@@ -0,0 +1,288 @@
+/**
+ * @copyright Copyright (c) 2025, Spencer.Luo. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the
+ * License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either
+ * express or implied. See the License for the specific language governing permissions and
+ * limitations.
+ *
+ * @file task_function.h
+ * @brief Move-only callable wrapper with small buffer optimization, used as the task type of
+ * threadpool and eventloop.
+ * @author Spencer
+ * @date 2026-10-18
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace cutl
+{
+
+/**
+ * @brief A move-only wrapper of a callable object with the signature void().
+ * Unlike std::function, the callable object does not need to be copyable (such as
+ * std::packaged_task or a lambda capturing std::unique_ptr), and the callable object whose size is
+ * not greater than buffer_size is stored in the object itself without allocating any memory.
+ *
+ */
+class task_function
+{
+public:
+    /**
+     * @brief The size of the inline buffer. The buffer together with the pointer to the operation
+     * table is 7 pointers (56 bytes on 64-bit platforms), so that a task_function alone plus the
+     * sequence number of a mpmc_queue cell fits in one cache line. The queues of eventloop and
+     * threadpool also store a timestamp with each task, so their cells are 72 bytes.
+     *
+     */
+    static constexpr size_t buffer_size = 6 * sizeof(void*);
+
+private:
+    using storage_type = typename std::aligned_storage<buffer_size, alignof(void*)>::type;
+
+    // 被包装对象的操作函数表，每种被包装类型一个静态实例
+    struct operations
+    {
+        void (*invoke)(storage_type& storage);
+        // 将src中的对象移动到dst中，并析构src中的对象
+        void (*relocate)(storage_type& dst, storage_type& src) noexcept;
+        void (*destroy)(storage_type& storage) noexcept;
+        bool is_inline;
+    };
+
+    template<typename F>
+    struct fits_inline
+      : std::integral_constant<bool,
+                               sizeof(F) <= buffer_size && alignof(F) <= alignof(storage_type) &&
+                                 std::is_nothrow_move_constructible<F>::value>
+    {
+    };
+
+    // 小对象直接存放在storage_中
+    template<typename F>
+    struct inline_operations
+    {
+        static F& get(storage_type& storage) { return *reinterpret_cast<F*>(&storage); }
+        static void invoke(storage_type& storage) { get(storage)(); }
+        static void relocate(storage_type& dst, storage_type& src) noexcept
+        {
+            new (&dst) F(std::move(get(src)));
+            get(src).~F();
+        }
+        static void destroy(storage_type& storage) noexcept { get(storage).~F(); }
+        static const operations* table()
+        {
+            static const operations ops = { &invoke, &relocate, &destroy, true };
+            return &ops;
+        }
+    };
+
+    // 大对象分配在堆上，storage_中存放其指针
+    template<typename F>
+    struct heap_operations
+    {
+        static F*& get(storage_type& storage) { return *reinterpret_cast<F**>(&storage); }
+        static void invoke(storage_type& storage) { (*get(storage))(); }
+        static void relocate(storage_type& dst, storage_type& src) noexcept
+        {
+            new (&dst) F*(get(src));
+        }
+        static void destroy(storage_type& storage) noexcept { delete get(storage); }
+        static const operations* table()
+        {
+            static const operations ops = { &invoke, &relocate, &destroy, false };
+            return &ops;
+        }
+    };
+
+    template<typename F>
+    using enable_if_callable = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, task_function>::value &&
+      !std::is_same<typename std::decay<F>::type, std::nullptr_t>::value>::type;
+
+public:
+    /**
+     * @brief Construct an empty task_function object
+     *
+     */
+    task_function() noexcept
+      : ops_(nullptr)
+    {
+    }
+
+    /**
+     * @brief Construct an empty task_function object
+     *
+     */
+    task_function(std::nullptr_t) noexcept
+      : ops_(nullptr)
+    {
+    }
+
+    /**
+     * @brief Construct a new task_function object from a callable object.
+     * @note An empty std::function or a null function pointer results in an empty task_function.
+     *
+     * @tparam F the type of the callable object
+     * @param f the callable object
+     */
+    template<typename F, typename = enable_if_callable<F>>
+    task_function(F&& f)
+      : ops_(nullptr)
+    {
+        using functor = typename std::decay<F>::type;
+        if (is_null(f))
+        {
+            return;
+        }
+        construct<functor>(std::forward<F>(f), fits_inline<functor>());
+    }
+
+    /**
+     * @brief Move constructor, other becomes empty.
+     *
+     * @param other the other task_function object
+     */
+    task_function(task_function&& other) noexcept
+      : ops_(other.ops_)
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->relocate(storage_, other.storage_);
+            other.ops_ = nullptr;
+        }
+    }
+
+    /**
+     * @brief Move assignment, other becomes empty.
+     *
+     * @param other the other task_function object
+     * @return task_function&
+     */
+    task_function& operator=(task_function&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            if (other.ops_ != nullptr)
+            {
+                other.ops_->relocate(storage_, other.storage_);
+                ops_ = other.ops_;
+                other.ops_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Destroy the wrapped callable object, the task_function becomes empty.
+     *
+     * @return task_function&
+     */
+    task_function& operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+
+    /**
+     * @brief Destroy the task_function object
+     *
+     */
+    ~task_function() { reset(); }
+
+    // 不可以复制
+    task_function(const task_function&) = delete;
+    task_function& operator=(const task_function&) = delete;
+
+    /**
+     * @brief Invoke the wrapped callable object.
+     * @note Throw std::bad_function_call if the task_function is empty.
+     *
+     */
+    void operator()()
+    {
+        if (ops_ == nullptr)
+        {
+            throw std::bad_function_call();
+        }
+        ops_->invoke(storage_);
+    }
+
+    /**
+     * @brief Whether the task_function wraps a callable object or not.
+     *
+     * @return true
+     * @return false
+     */
+    explicit operator bool() const noexcept { return ops_ != nullptr; }
+
+    /**
+     * @brief Whether the wrapped callable object is stored in the inline buffer (no heap
+     * allocation) or not.
+     *
+     * @return true
+     * @return false
+     */
+    bool is_inline() const noexcept { return ops_ != nullptr && ops_->is_inline; }
+
+private:
+    template<typename Functor, typename F>
+    void construct(F&& f, std::true_type /*inline*/)
+    {
+        new (&storage_) Functor(std::forward<F>(f));
+        ops_ = inline_operations<Functor>::table();
+    }
+
+    template<typename Functor, typename F>
+    void construct(F&& f, std::false_type /*inline*/)
+    {
+        new (&storage_) Functor*(new Functor(std::forward<F>(f)));
+        ops_ = heap_operations<Functor>::table();
+    }
+
+    void reset() noexcept
+    {
+        if (ops_ != nullptr)
+        {
+            ops_->destroy(storage_);
+            ops_ = nullptr;
+        }
+    }
+
+    template<typename F>
+    static bool is_null(const F&)
+    {
+        return false;
+    }
+
+    template<typename R, typename... Args>
+    static bool is_null(R (*const& f)(Args...))
+    {
+        return f == nullptr;
+    }
+
+    template<typename R, typename... Args>
+    static bool is_null(const std::function<R(Args...)>& f)
+    {
+        return !f;
+    }
+
+private:
+    const operations* ops_;
+    storage_type storage_;
+};
+
+} // namespace cutl
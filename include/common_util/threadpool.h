@@ -20,11 +20,17 @@
 
 #pragma once
 
+#include "histogram.h"
+#include "mpmc_queue.h"
+#include "task_function.h"
+#include "threadutil.h"
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
-#include <list>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -33,6 +39,114 @@
 namespace cutl
 {
 
+/**
+ * @brief The task scheduling mode of the thread pool
+ *
+ */
+enum class threadpool_mode
+{
+    /** All workers take tasks from one shared task queue */
+    shared_queue,
+    /**
+     * Each worker owns a local deque. Tasks submitted from inside a worker go to its local deque,
+     * idle workers steal tasks from the other workers.
+     */
+    work_stealing,
+};
+
+/**
+ * @brief The priority of the task.
+ * Workers take tasks from the higher priority lane first. To keep the lower lanes making progress,
+ * every 4th pick of a worker starts from the normal lane, and every 16th pick starts from the low
+ * lane.
+ *
+ */
+enum class task_priority
+{
+    /** Latency-critical tasks */
+    high = 0,
+    /** Default priority */
+    normal = 1,
+    /** Background tasks */
+    low = 2,
+};
+
+/**
+ * @brief The elastic sizing policy of the thread pool.
+ * The thread pool starts with min_threads workers. When the pending tasks are more than the free
+ * workers, a new worker is created until max_threads. A worker that has been idle for keep_alive
+ * exits, until there are min_threads workers.
+ *
+ */
+struct threadpool_sizing
+{
+    /** The minimum number of worker threads, at least 1 */
+    uint32_t min_threads = 1;
+    /** The maximum number of worker threads, 0 means std::thread::hardware_concurrency() */
+    uint32_t max_threads = 0;
+    /** The idle time after which a worker above min_threads exits */
+    std::chrono::milliseconds keep_alive = std::chrono::milliseconds(60000);
+};
+
+/**
+ * @brief The idle policy of the worker threads.
+ * When there is no task, a worker spins spin_count rounds, then calls std::this_thread::yield()
+ * yield_count rounds, and finally parks on the condition variable until a new task arrives.
+ * More spinning means lower wakeup latency but more CPU usage when the threadpool is idle.
+ *
+ */
+struct threadpool_idle_policy
+{
+    /** The number of rounds to spin before yielding, 0 means not spinning */
+    uint32_t spin_count = 64;
+    /** The number of rounds to yield before parking, 0 means not yielding */
+    uint32_t yield_count = 4;
+};
+
+/**
+ * @brief The statistics of a worker thread of the thread pool.
+ *
+ */
+struct threadpool_worker_stats
+{
+    /** The index of the worker, the same as the suffix of the thread name */
+    uint32_t index = 0;
+    /** The number of tasks executed by the worker */
+    uint64_t executed = 0;
+    /** The ratio of the time executing tasks to the lifetime of the current worker thread */
+    double busy_ratio = 0.0;
+};
+
+/**
+ * @brief The runtime statistics of the thread pool, the durations are in nanoseconds.
+ * @note The latency histograms and the busy ratio are only collected when the statistics is
+ * enabled (see threadpool::set_stats_enabled()).
+ *
+ */
+struct threadpool_stats
+{
+    /** The number of executed tasks */
+    uint64_t executed = 0;
+    /** The number of tasks rejected by add_task, because of the timeout or the stopped pool */
+    uint64_t rejected = 0;
+    /** The number of tasks waiting in the queues */
+    uint32_t pending = 0;
+    /** The maximum number of tasks waiting in the queues at the same time */
+    uint32_t queue_high_water = 0;
+    /** The number of worker threads */
+    uint32_t thread_count = 0;
+    /** The peak number of worker threads */
+    uint32_t peak_thread_count = 0;
+    /** The latency from adding a task to starting executing it */
+    histogram_snapshot wait_time;
+    /** The execution time of the tasks */
+    histogram_snapshot run_time;
+    /** The time the producers are blocked in add_task because the task queue is full */
+    histogram_snapshot block_time;
+    /** The statistics of the running worker threads */
+    std::vector<threadpool_worker_stats> workers;
+};
+
 /**
  * @brief The thread pool class
  *
@@ -40,7 +154,7 @@ namespace cutl
 class threadpool
 {
 public:
-    using Task = std::function<void()>;
+    using Task = task_function;
     using Duration = std::chrono::steady_clock::duration;
 
 public:
@@ -48,9 +162,12 @@ public:
      * @brief Construct a new threadpool object
      *
      * @param name
-     * @param max_task_size
+     * @param max_task_size the capacity of the task queue of each priority
+     * @param mode the task scheduling mode, default is threadpool_mode::shared_queue
      */
-    threadpool(const std::string& name, uint32_t max_task_size = 1024);
+    threadpool(const std::string& name,
+               uint32_t max_task_size = 1024,
+               threadpool_mode mode = threadpool_mode::shared_queue);
     /**
      * @brief Destroy the threadpool object
      *
@@ -58,12 +175,64 @@ public:
     ~threadpool();
 
     /**
-     * @brief Start the threadpool
+     * @brief Set the idle policy of the worker threads.
+     * @note It must be called before start().
+     *
+     * @param policy the idle policy
+     */
+    void set_idle_policy(const threadpool_idle_policy& policy);
+
+    /**
+     * @brief Enable or disable collecting the latency statistics, it is enabled by default.
+     * Collecting the latency costs three reads of std::chrono::steady_clock per task, the counters
+     * (executed, rejected, queue high-water, etc.) are always collected.
+     * @note It must be called before start().
+     *
+     * @param enabled
+     */
+    void set_stats_enabled(bool enabled);
+
+    /**
+     * @brief Set the CPU placement policy of the worker threads, the worker with index i (the
+     * suffix of the thread name) is placed as the i-th thread of the policy.
+     * @note It must be called before start().
      *
-     * @param num_threads
+     * @param placement the placement policy
+     */
+    void set_placement(const thread_placement& placement);
+
+    /**
+     * @brief Create one threadpool for each NUMA node, the workers of the i-th threadpool are
+     * bound to the CPUs of node i. Each threadpool is constructed and started on a thread bound to
+     * its node, so that its task queues are allocated in the node-local memory.
+     *
+     * @param name the name prefix of the threadpools, the i-th threadpool is named name + "_n" + i
+     * @param threads_per_node the number of threads of each threadpool, 0 means the number of
+     * CPUs of the node
+     * @param max_task_size the capacity of the task queue of each priority
+     * @param mode the task scheduling mode
+     * @return std::vector<std::unique_ptr<threadpool>> the started threadpools, indexed by node
+     */
+    static std::vector<std::unique_ptr<threadpool>> create_per_numa_node(
+      const std::string& name,
+      uint32_t threads_per_node = 0,
+      uint32_t max_task_size = 1024,
+      threadpool_mode mode = threadpool_mode::shared_queue);
+
+    /**
+     * @brief Start the threadpool with a fixed number of threads
+     *
+     * @param num_threads the number of threads, 0 means std::thread::hardware_concurrency()
      */
     void start(uint32_t num_threads = 0);
 
+    /**
+     * @brief Start the threadpool with an elastic sizing policy
+     *
+     * @param sizing the sizing policy
+     */
+    void start(const threadpool_sizing& sizing);
+
     /**
      * @brief Stop the threadpool
      *
@@ -73,22 +242,101 @@ public:
 
     /**
      * @brief Add a task to the threadpool
+     * @note In threadpool_mode::work_stealing mode, the normal priority task submitted from a
+     * worker thread of this threadpool is pushed to the local deque of the worker.
      *
-     * @param task the task function
+     * @param task the task function, a small callable object is stored without allocation
+     * @param priority the priority of the task
      * @return true
      * @return false
      */
-    bool add_task(const Task& task);
+    bool add_task(Task&& task, task_priority priority = task_priority::normal);
 
     /**
      * @brief Add a task to the threadpool with timeout
      *
      * @param task the task function
      * @param timeout the timeout duration
+     * @param priority the priority of the task
      * @return true
      * @return false
      */
-    bool add_task(const Task& task, const Duration& timeout);
+    bool add_task(Task&& task,
+                  const Duration& timeout,
+                  task_priority priority = task_priority::normal);
+
+    /**
+     * @brief Add a batch of tasks to the threadpool.
+     * All tasks are enqueued at once, and the number of workers needed is woken up only once.
+     * @note If the threadpool is stopped while waiting for the space of the task queue, the tasks
+     * that have not been enqueued are discarded.
+     *
+     * @param tasks the task functions
+     * @param priority the priority of the tasks
+     * @return true if all tasks are added, false otherwise.
+     */
+    bool add_tasks(std::vector<Task>&& tasks, task_priority priority = task_priority::normal);
+
+    /**
+     * @brief Add as many tasks of the batch as the task queue can hold without waiting.
+     * The tasks are enqueued from the front of tasks, the remaining ones are discarded (not counted
+     * as rejected). It never blocks, so it is safe to call from a worker of the same threadpool.
+     *
+     * @param tasks the task functions
+     * @param priority the priority of the tasks
+     * @return size_t the number of tasks added, 0 if the threadpool is stopped.
+     */
+    size_t try_add_tasks(std::vector<Task>&& tasks,
+                         task_priority priority = task_priority::normal);
+
+    /**
+     * @brief Add a batch of tasks in the range [first, last) to the threadpool.
+     *
+     * @tparam InputIt the type of iterator, the element type must be convertible to Task, use
+     * std::make_move_iterator() for a range of Task
+     * @param first the first task
+     * @param last the end of the tasks
+     * @param priority the priority of the tasks
+     * @return true if all tasks are added, false otherwise.
+     */
+    template<typename InputIt>
+    bool add_tasks(InputIt first, InputIt last, task_priority priority = task_priority::normal)
+    {
+        return add_tasks(std::vector<Task>(first, last), priority);
+    }
+
+    /**
+     * @brief Add a batch of tasks with return value to the threadpool.
+     *
+     * @tparam F the type of the task function, it takes no argument.
+     * @param funcs the task functions
+     * @param priority the priority of the tasks
+     * @return std::vector<std::future<typename std::result_of<F()>::type>> the futures of the
+     * results, in the same order as funcs.
+     */
+    template<class F>
+    auto add_tasks_with_return(std::vector<F> funcs, task_priority priority = task_priority::normal)
+      -> std::vector<std::future<typename std::result_of<F()>::type>>
+    {
+        using return_type = typename std::result_of<F()>::type;
+
+        std::vector<std::future<return_type>> results;
+        std::vector<Task> tasks;
+        results.reserve(funcs.size());
+        tasks.reserve(funcs.size());
+        for (auto& f : funcs)
+        {
+            std::packaged_task<return_type()> task(std::move(f));
+            results.emplace_back(task.get_future());
+            tasks.emplace_back(std::move(task));
+        }
+
+        if (!add_tasks(std::move(tasks), priority))
+        {
+            throw std::runtime_error("add tasks failure!");
+        }
+        return results;
+    }
 
     /**
      * @brief Add a task to the threadpool with args and return
@@ -100,27 +348,130 @@ public:
     template<class F, class... Args>
     auto add_task_with_args_and_return(F&& f, Args&&... args)
       -> std::future<typename std::result_of<F(Args...)>::type>
+    {
+        return add_task_with_args_and_return(
+          task_priority::normal, std::forward<F>(f), std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Add a task with priority to the threadpool with args and return
+     *
+     * @param priority the priority of the task
+     * @param f
+     * @param args
+     * @return std::future<typename std::result_of<F(Args...)>::type>
+     */
+    template<class F, class... Args>
+    auto add_task_with_args_and_return(task_priority priority, F&& f, Args&&... args)
+      -> std::future<typename std::result_of<F(Args...)>::type>
     {
         using return_type = typename std::result_of<F(Args...)>::type;
 
-        auto task = std::make_shared<std::packaged_task<return_type()>>(
+        // packaged_task是move-only的，直接移入任务中，不需要额外的shared_ptr
+        std::packaged_task<return_type()> task(
           std::bind(std::forward<F>(f), std::forward<Args>(args)...));
 
-        std::future<return_type> res = task->get_future();
+        std::future<return_type> res = task.get_future();
         {
-            auto res = add_task([task]() { (*task)(); });
+            auto res = add_task(std::move(task), priority);
             if (!res)
             {
                 throw std::runtime_error("add task failure!");
             }
         }
-        cv_consumer_.notify_one();
         return res;
     }
 
+    /**
+     * @brief Get the task scheduling mode of the threadpool
+     *
+     * @return threadpool_mode
+     */
+    threadpool_mode mode() const { return mode_; }
+
+    /**
+     * @brief Get the number of worker threads of the threadpool
+     *
+     * @return uint32_t
+     */
+    uint32_t thread_count() const { return thread_count_.load(); }
+
+    /**
+     * @brief Get the number of tasks waiting in the lane of the priority.
+     * @note The tasks in the local deques of the workers (threadpool_mode::work_stealing) are
+     * not counted.
+     *
+     * @param priority the priority lane
+     * @return size_t
+     */
+    size_t queue_size(task_priority priority) const;
+
+    /**
+     * @brief Get the runtime statistics of the threadpool.
+     * The workers record to their own counters and the statistics are merged here, so collecting
+     * the statistics adds no contention between the workers.
+     *
+     * @return threadpool_stats
+     */
+    threadpool_stats stats() const;
+
+    /**
+     * @brief Get the peak number of worker threads since the threadpool is created
+     *
+     * @return uint32_t
+     */
+    uint32_t peak_thread_count() const { return peak_thread_count_.load(); }
+
+private:
+    using TimePoint = std::chrono::steady_clock::time_point;
+
+    // 队列中的任务，附带入队时间用于统计等待时延
+    struct queued_task
+    {
+        Task task;
+        TimePoint enqueue_time;
+    };
+
+    // 工作线程本地的任务队列(work_stealing模式)
+    struct worker_queue
+    {
+        std::mutex mutex;
+        std::deque<queued_task> tasks;
+    };
+
+    // 工作线程自己的统计数据，只有该工作线程写入，stats()中汇总
+    struct worker_stats
+    {
+        std::atomic<uint64_t> executed{ 0 };
+        std::atomic<uint64_t> busy_ns{ 0 };
+        std::atomic<int64_t> started_ns{ 0 };
+        latency_histogram wait_time;
+        latency_histogram run_time;
+        // 每个工作线程的统计数据单独分配，填充避免与相邻的内存产生伪共享
+        char padding[64];
+    };
+
 private:
-    void call_one_task();
+    void run_task(queued_task& item, uint32_t index);
     void clear();
+    // 线程数的弹性伸缩
+    void add_worker();
+    void grow_if_needed();
+    bool try_retire(uint32_t slot);
+    // 工作线程的任务调度
+    void worker_loop(uint32_t index);
+    bool park_worker();
+    bool push_local_task(queued_task& item, task_priority priority);
+    size_t push_local_tasks(std::vector<Task>& tasks, task_priority priority, TimePoint now);
+    bool push_global_task(queued_task& item, task_priority priority, const Duration* timeout);
+    bool pop_task(uint32_t index, queued_task& item);
+    bool pop_global_task(queued_task& item);
+    bool pop_lane_task(task_priority priority, queued_task& item);
+    bool steal_task(uint32_t index, queued_task& item);
+    TimePoint enqueue_time() const;
+    void add_pending(size_t count);
+    void publish_tasks(size_t count);
+    void notify_blocked_producer();
 
 private:
     // 线程池的名称
@@ -129,12 +480,47 @@ private:
     std::atomic<bool> is_running_;
     // 线程池中的线程对象
     std::vector<std::thread> threads_;
-    // 任务队列
+    // 优先级的个数
+    static constexpr size_t priority_count = 3;
+    // 任务队列(无锁的有界队列)，每个优先级一个队列
+    // task_mutex_仅用于 生产者和消费者 的等待与唤醒
     std::mutex task_mutex_;
-    std::list<Task> task_queue_;
+    std::unique_ptr<mpmc_queue<queued_task>> task_queues_[priority_count];
     uint32_t max_task_size_;
     std::condition_variable cv_producer_;
     std::condition_variable cv_consumer_;
+    // 任务调度模式
+    threadpool_mode mode_;
+    // 工作线程本地的任务队列(work_stealing模式)
+    std::vector<std::unique_ptr<worker_queue>> worker_queues_;
+    // 所有队列中待执行的任务数
+    std::atomic<uint32_t> pending_tasks_;
+    // 空闲(挂起等待任务)的工作线程数
+    std::atomic<uint32_t> idle_workers_;
+    // 因任务队列已满而等待的生产者数
+    std::atomic<uint32_t> blocked_producers_;
+    // 线程数的弹性伸缩，threads_mutex_保护threads_、retired_threads_和free_slots_
+    mutable std::mutex threads_mutex_;
+    std::vector<std::thread> retired_threads_;
+    std::vector<uint32_t> free_slots_;
+    uint32_t min_threads_;
+    uint32_t max_threads_;
+    std::chrono::milliseconds keep_alive_;
+    bool elastic_;
+    std::atomic<uint32_t> thread_count_;
+    std::atomic<uint32_t> peak_thread_count_;
+    // 正在执行任务的工作线程数
+    std::atomic<uint32_t> busy_workers_;
+    // 工作线程的空闲策略
+    threadpool_idle_policy idle_policy_;
+    // 工作线程的CPU绑定策略
+    thread_placement placement_;
+    // 运行时统计，每个工作线程一份worker_stats(与序号对应)
+    bool stats_enabled_;
+    std::vector<std::unique_ptr<worker_stats>> worker_stats_;
+    std::atomic<uint64_t> rejected_tasks_;
+    std::atomic<uint32_t> queue_high_water_;
+    latency_histogram block_time_;
 };
 
 } // namespace cutl
@@ -1,9 +1,11 @@
 ﻿#pragma once
 
+#include "eventloop.h"
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -11,23 +13,225 @@
 namespace cutl
 {
 
-template<typename Callable, typename... Args>
-void set_timeout(Callable&& f, uint32_t delay_ms, Args&&... args)
+// timer_service中的定时任务，定义在timer.cpp中
+struct timer_entry;
+struct timer_counters;
+class timer_service;
+
+/**
+ * @brief The scheduling mode of a periodic timer.
+ *
+ */
+enum class timer_mode
 {
-    // 将函数和参数绑定，并移动到线程中
-    auto task = std::bind(std::forward<Callable>(f), std::forward<Args>(args)...);
+    /**
+     * The task is scheduled at start + n * interval regardless of how long it runs. When the task
+     * is late by whole intervals, the missed runs are skipped (not run in a burst).
+     */
+    fixed_rate,
+    /** The next run is scheduled one interval after the previous run finishes */
+    fixed_delay,
+};
 
-    std::thread(
-      [delay_ms, task]() mutable
-      {
-          // 等待指定延迟
-          std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+/**
+ * @brief The lateness statistics of a timer, the lateness is the time between the scheduled time
+ * and the actual start time of each run.
+ *
+ */
+struct timer_stats
+{
+    /** The number of runs */
+    uint64_t run_count = 0;
+    /** The number of runs skipped because the task was late by whole intervals (fixed_rate) */
+    uint64_t skipped_count = 0;
+    /** The lateness of the last run */
+    std::chrono::nanoseconds last_lateness{ 0 };
+    /** The max lateness of all runs */
+    std::chrono::nanoseconds max_lateness{ 0 };
+    /** The mean lateness of all runs */
+    std::chrono::nanoseconds mean_lateness{ 0 };
+};
 
-          // 执行目标函数
-          task();
-      })
-      .detach(); // 分离线程，让其独立运行
-}
+/**
+ * @brief The options of a timer service.
+ *
+ */
+struct timer_service_options
+{
+    /** The backend of the timer queue (binary heap or timing wheel) */
+    eventloop_timer_options queue;
+    /**
+     * Spin (busy wait) for the last spin_threshold before each deadline instead of sleeping, to
+     * reduce the jitter to a few microseconds at the cost of CPU usage. Use it with the heap
+     * backend, the timing wheel rounds the deadlines up to its tick.
+     */
+    bool high_resolution = false;
+    /** The spinning time before each deadline in the high resolution mode */
+    std::chrono::microseconds spin_threshold{ 100 };
+};
+
+/**
+ * @brief The handle of a task scheduled by timer_service::run_after() or run_every(), such as the
+ * return value of set_timeout() and set_interval(). The caller can use it to cancel the task.
+ * Destroying the handle does not cancel the task.
+ *
+ */
+class timer_handle
+{
+    friend class timer_service;
+
+public:
+    timer_handle() = default;
+
+    /**
+     * @brief Cancel the task. A pending task is removed from the service immediately, a running
+     * callback is not interrupted and the task is not rescheduled after it.
+     *
+     */
+    void cancel();
+
+    /**
+     * @brief Is the task still pending (a timeout has not run yet, or an interval is not
+     * canceled)?
+     *
+     * @return true
+     * @return false
+     */
+    bool is_valid() const;
+
+private:
+    timer_handle(timer_service* service, const std::shared_ptr<timer_entry>& entry);
+
+    timer_service* service_ = nullptr;
+    // 弱引用，任务执行完毕后即被释放
+    std::weak_ptr<timer_entry> entry_;
+};
+
+/**
+ * @brief A timer service runs many timers on one thread, so that the number of threads does not
+ * grow with the number of periodic jobs. The thread sleeps until the nearest deadline (with a
+ * timerfd on Linux for sub-millisecond precision).
+ * @note The tasks run in the thread of the service one by one, a long task delays the other
+ * timers of the same service. Use separate services for slow jobs or high resolution timers.
+ *
+ */
+class timer_service
+{
+    friend class timer;
+    friend class timer_handle;
+
+public:
+    /**
+     * @brief Construct a new timer service object
+     *
+     * @param name the name of the service thread
+     * @param options the options of the service
+     */
+    explicit timer_service(const std::string& name,
+                           const timer_service_options& options = timer_service_options());
+    /**
+     * @brief Destroy the timer service object, the thread is stopped.
+     * @note Do not destroy the service in one of its own timer tasks, the thread of the service is
+     * still running the task.
+     *
+     */
+    ~timer_service();
+
+    // 不可以复制
+    timer_service(const timer_service&) = delete;
+    timer_service& operator=(const timer_service&) = delete;
+
+    /**
+     * @brief Get the process-wide default timer service, which is started on first use.
+     *
+     * @return timer_service&
+     */
+    static timer_service& default_service();
+
+    /**
+     * @brief Start the thread of the service, it is called by timer::start() automatically.
+     *
+     */
+    void start();
+
+    /**
+     * @brief Stop the thread of the service. The timers are kept and continue after start().
+     * It can be called in a timer task of the service, then it does not wait for the thread, which
+     * exits after the task returns.
+     *
+     */
+    void stop();
+
+    /**
+     * @brief Is the service running or not?
+     *
+     * @return true
+     * @return false
+     */
+    bool is_running() const { return running_.load(); }
+
+    /**
+     * @brief Get the number of the timers scheduled in the service.
+     *
+     * @return size_t
+     */
+    size_t timer_count() const;
+
+    /**
+     * @brief Run the task once after the delay in the thread of the service.
+     *
+     * @param delay the delay
+     * @param func the task
+     * @return timer_handle the handle to cancel the task
+     */
+    timer_handle run_after(EventloopDuration delay, const EventloopTimerFunc& func);
+
+    /**
+     * @brief Run the task every interval in the thread of the service, the first run is after one
+     * interval.
+     *
+     * @param interval the interval
+     * @param func the task
+     * @param mode fixed rate or fixed delay
+     * @return timer_handle the handle to cancel the task
+     */
+    timer_handle run_every(EventloopDuration interval,
+                           const EventloopTimerFunc& func,
+                           timer_mode mode = timer_mode::fixed_rate);
+
+private:
+    // 添加定时任务
+    void add(const std::shared_ptr<timer_entry>& entry);
+    // 移除定时任务，wait为true时等待正在执行的任务结束(在服务线程中调用时不等待)
+    void remove(const std::shared_ptr<timer_entry>& entry, bool wait);
+    // 服务线程的主循环
+    void run();
+    // 等待超时或被唤醒，调用时持有mutex_
+    void wait_for(std::unique_lock<std::mutex>& lock, EventloopDuration timeout);
+    // 执行到期的定时任务，调用时持有mutex_
+    void run_expired(std::unique_lock<std::mutex>& lock);
+    // 唤醒服务线程，重新计算等待时间
+    void wakeup();
+
+private:
+    std::string name_;
+    timer_service_options options_;
+    std::atomic<bool> running_;
+    // 保护thread_的创建和等待(服务线程自身不加锁)
+    std::mutex lifecycle_mutex_;
+    std::thread thread_;
+    std::atomic<std::thread::id> thread_id_;
+    // 定时任务队列(最小堆或时间轮)
+    mutable std::mutex mutex_;
+    std::unique_ptr<timer_queue> queue_;
+    // 正在执行的定时任务，stop时等待其执行完毕
+    timer_entry* executing_;
+    std::condition_variable executed_cv_;
+    // IO多路复用器(Linux下使用timerfd等待)，为空时使用条件变量等待
+    std::unique_ptr<io_poller> poller_;
+    std::condition_variable wakeup_cv_;
+    bool wakeup_pending_;
+};
 
 class timer
 {
@@ -38,26 +242,81 @@ public:
     timer() = delete;
     timer(const timer&) = delete;
     timer& operator=(const timer&) = delete;
-    timer(const std::string& name, Task task, Duration interval);
+    /**
+     * @brief Construct a new timer object, the task runs immediately after start() and then
+     * every interval.
+     *
+     * @param name the name of timer
+     * @param task the task
+     * @param interval the interval of the task
+     * @param mode fixed rate or fixed delay
+     * @param service the timer service to run the task, nullptr means the default service
+     */
+    timer(const std::string& name,
+          Task task,
+          Duration interval,
+          timer_mode mode = timer_mode::fixed_rate,
+          timer_service* service = nullptr);
     ~timer();
 
     void start();
 
     void stop(bool wait_for_stop = true);
 
-    bool is_running() const { return running_.load(); }
+    bool is_running() const;
 
-private:
-    void run();
+    /**
+     * @brief Get the lateness statistics of the timer, they are kept across stop() and start().
+     *
+     * @return timer_stats
+     */
+    timer_stats stats() const;
 
-    std::atomic_bool running_{ false };
+private:
     std::string name_;
     Task task_;
-    std::chrono::steady_clock::time_point current_period_start_;
     Duration interval_;
-    std::thread thread_;
-    std::mutex mutex_stopping_;
-    std::condition_variable cv_stopping_;
+    timer_mode mode_;
+    timer_service* service_;
+    // 当前在timer_service中调度的定时任务，每次start时重新创建
+    std::shared_ptr<timer_entry> entry_;
+    std::shared_ptr<timer_counters> counters_;
 };
 
+/**
+ * @brief Run the callable once after the delay. All the timeouts share the thread of
+ * timer_service::default_service(), so there is no thread per call.
+ * @note The callable runs in the thread of the service, a long task delays the other timers.
+ *
+ * @param f the callable object
+ * @param delay_ms the delay in milliseconds
+ * @param args the arguments of the callable object
+ * @return timer_handle the handle to cancel the timeout
+ */
+template<typename Callable, typename... Args>
+timer_handle set_timeout(Callable&& f, uint32_t delay_ms, Args&&... args)
+{
+    // 将函数和参数绑定，在定时服务的线程中执行
+    auto task = std::bind(std::forward<Callable>(f), std::forward<Args>(args)...);
+    return timer_service::default_service().run_after(std::chrono::milliseconds(delay_ms),
+                                                      [task]() mutable { task(); });
+}
+
+/**
+ * @brief Run the callable every interval until the returned handle is canceled, the first run is
+ * after one interval. All the intervals share the thread of timer_service::default_service().
+ *
+ * @param f the callable object
+ * @param interval_ms the interval in milliseconds
+ * @param args the arguments of the callable object
+ * @return timer_handle the handle to cancel the interval
+ */
+template<typename Callable, typename... Args>
+timer_handle set_interval(Callable&& f, uint32_t interval_ms, Args&&... args)
+{
+    auto task = std::bind(std::forward<Callable>(f), std::forward<Args>(args)...);
+    return timer_service::default_service().run_every(std::chrono::milliseconds(interval_ms),
+                                                      [task]() mutable { task(); });
+}
+
 } // namespace cutl
@@ -1,84 +1,14 @@
 ﻿#include "eventloop.h"
+#include "inner/io_poller.h"
 #include "inner/logger.h"
+#include "inner/timer_queue.h"
 #include "threadutil.h"
+#include <algorithm>
+#include <iterator>
 
 namespace cutl
 {
 
-struct TimerTask
-{
-    TimerTask(const std::string& name,
-              const EventloopTimePoint& next_run_time,
-              const EventloopDuration& period,
-              const EventloopTask& func,
-              int64_t repeat_times)
-      : name_(name)
-      , next_run_time_(next_run_time)
-      , period_(period)
-      , func_(std::move(func))
-      , left_times_(repeat_times)
-    {
-    }
-
-    bool is_valid() const { return left_times_.load() != 0; }
-
-    void cancel()
-    {
-        left_times_.store(0);
-        CUTL_WARN("TimerTask[" + name_ + "] is canceled.");
-    }
-
-    void update_left_times()
-    {
-        if (left_times_.load() > 0)
-        {
-            left_times_.store(left_times_.load() - 1);
-        }
-    }
-
-    void update_next_run_time(EventloopTimePoint now)
-    {
-        next_run_time_ += period_;
-        if (next_run_time_ < now)
-        {
-            // 当前时间超出期望(的执行)时间至少一个周期，则调整期望的执行时间
-            if (now - next_run_time_ > period_)
-            {
-                auto delta =
-                  std::chrono::duration_cast<std::chrono::nanoseconds>(next_run_time_ - now)
-                    .count();
-                int period_ns = period_.count();
-                CUTL_WARN("TimerTask[" + name_ +
-                          "] The current time exceeds the expected time by at least one period_[" +
-                          std::to_string(period_ns) + "ns]. Delta: " + std::to_string(delta) +
-                          "ns");
-
-                next_run_time_ = now;
-            }
-        }
-    }
-
-    bool operator<(const TimerTask& other) const { return next_run_time_ < other.next_run_time_; }
-
-    // 名称
-    std::string name_;
-    // 触发时间
-    EventloopTimePoint next_run_time_;
-    // 任务的轮训周期
-    EventloopDuration period_;
-    // 任务
-    EventloopTask func_;
-    // 剩余的执行次数（-1: 表示无限循环）
-    std::atomic<int64_t> left_times_;
-};
-
-// 定时任务队列的比较函数: 定义最小堆
-bool TimerTaskCompare(const TimerTaskPtr& a, const TimerTaskPtr& b)
-{
-    // a > b: 表示最小堆
-    return *b < *a;
-}
-
 timer_task_handler::timer_task_handler(const TimerTaskPtr& timer_task)
   : timer_task_(timer_task)
 {
@@ -102,10 +32,12 @@ timer_task_handler& timer_task_handler::operator=(timer_task_handler&& other) no
 void timer_task_handler::cancel()
 {
     auto p = timer_task_.lock();
-    if (p)
+    // 重复取消，或者任务已经执行完毕时，不需要再从队列中移除
+    if (p && p->cancel() && p->owner_ != nullptr)
     {
-        p->cancel();
+        p->owner_->cancel_timer_task(p.get());
     }
+    timer_task_.reset();
 }
 
 /*
@@ -123,44 +55,288 @@ bool timer_task_handler::isvalid()
 eventloop::eventloop(uint32_t task_max_size, uint32_t timer_task_max_size)
   : is_running_(false)
   , loop_thread_id_()
-  , task_queue_()
+  , sleeping_(false)
+  , task_queue_(task_max_size)
   , task_max_size_(task_max_size)
+  , dropped_count_(0)
+  , above_high_watermark_(false)
+  , overflow_size_(0)
+  , blocked_producers_(0)
   , timer_task_mutex_()
-  , timer_task_queue_(&TimerTaskCompare)
+  , timer_task_queue_(new heap_timer_queue())
   , timer_task_max_size_(timer_task_max_size)
+  , cancelled_timer_count_(0)
+  , io_poller_(create_io_poller())
+  , fd_watcher_id_(0)
+  , stats_enabled_(true)
+  , slow_threshold_(EventloopDuration::zero())
+  , executed_tasks_(0)
+  , executed_timers_(0)
+  , slow_handlers_(0)
+  , iterations_(0)
+  , wake_time_()
 {
 }
 
 eventloop::~eventloop() {}
 
-bool eventloop::post_event(const EventloopTask& task)
+eventloop_post_status eventloop::post_event(EventloopTask&& task)
 {
-    bool empty = true;
+    eventloop_post_status status = eventloop_post_status::success;
+    queued_task item{ std::move(task), post_time() };
+    // 溢出队列不为空时，新任务排在溢出队列之后
+    if (overflow_size_.load() > 0 || !task_queue_.try_push(std::move(item)))
     {
-        std::lock_guard<std::mutex> guard(task_mutex_);
-        if (task_queue_.size() >= task_max_size_)
+        status = post_overflow(item);
+        if (status == eventloop_post_status::rejected ||
+            status == eventloop_post_status::timeout ||
+            status == eventloop_post_status::ran_in_caller)
         {
-            CUTL_ERROR(
-              "Task queue is full, discard task. size:" + std::to_string(task_queue_.size()) +
-              ", max_size:" + std::to_string(task_max_size_));
-            return false;
+            return status;
         }
-        empty = task_queue_.empty();
-        task_queue_.emplace_back(task);
     }
 
-    // 如果该任务是第一个任务，唤醒Loop线程进行处理
-    if (empty)
+    // Loop线程忙碌时会在下一轮处理新任务，只有在等待时才需要唤醒(系统调用)
+    wakeup_if_sleeping();
+
+    // 到达高水位时通知生产者限流，直到回落到低水位前只通知一次
+    if (queue_options_.high_watermark > 0 && !above_high_watermark_.load())
     {
-        wakeup();
+        size_t size = task_count();
+        if (size >= queue_options_.high_watermark && !above_high_watermark_.exchange(true) &&
+            queue_options_.on_high_watermark)
+        {
+            queue_options_.on_high_watermark(size);
+        }
     }
 
+    return status;
+}
+
+bool eventloop::set_queue_options(const eventloop_queue_options& options)
+{
+    if (is_running_.load())
+    {
+        CUTL_WARN("The event loop is running, the queue options can not be changed");
+        return false;
+    }
+    queue_options_ = options;
     return true;
 }
 
-void eventloop::start()
+eventloop_post_status eventloop::post_overflow(queued_task& item)
+{
+    switch (queue_options_.overflow)
+    {
+        case eventloop_overflow_policy::drop_oldest:
+        {
+            // 丢弃最早的任务，直到新任务可以放入队列
+            queued_task oldest;
+            do
+            {
+                if (pop_task(oldest))
+                {
+                    oldest.task = nullptr;
+                    record_dropped();
+                }
+            } while (!task_queue_.try_push(std::move(item)));
+            return eventloop_post_status::dropped_oldest;
+        }
+        case eventloop_overflow_policy::block:
+            // 在事件循环线程中阻塞会导致死锁，直接丢弃
+            if (is_loop_thread() || !push_blocking(item))
+            {
+                record_dropped();
+                return eventloop_post_status::timeout;
+            }
+            return eventloop_post_status::success;
+        case eventloop_overflow_policy::grow:
+        {
+            std::lock_guard<std::mutex> lock(overflow_mutex_);
+            overflow_queue_.emplace_back(std::move(item));
+            overflow_size_++;
+            return eventloop_post_status::success;
+        }
+        case eventloop_overflow_policy::caller_runs:
+            item.task();
+            return eventloop_post_status::ran_in_caller;
+        case eventloop_overflow_policy::drop_newest:
+        default:
+            record_dropped();
+            return eventloop_post_status::rejected;
+    }
+}
+
+bool eventloop::push_blocking(queued_task& item)
+{
+    // 每次最多等待一小段时间后重试，避免错过唤醒
+    static constexpr auto wait_slice = std::chrono::milliseconds(10);
+
+    auto deadline = std::chrono::steady_clock::now() + queue_options_.block_timeout;
+    blocked_producers_++;
+    std::unique_lock<std::mutex> lock(space_mutex_);
+    bool pushed = task_queue_.try_push(std::move(item));
+    while (!pushed)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline)
+        {
+            break;
+        }
+        space_cv_.wait_until(lock, std::min<EventloopTimePoint>(deadline, now + wait_slice));
+        pushed = task_queue_.try_push(std::move(item));
+    }
+    lock.unlock();
+    blocked_producers_--;
+    return pushed;
+}
+
+void eventloop::record_dropped()
+{
+    // 按2的幂次打印日志，避免突发流量时刷屏
+    uint64_t count = ++dropped_count_;
+    if ((count & (count - 1)) == 0)
+    {
+        CUTL_ERROR("Task queue is full, " + std::to_string(count) +
+                   " task(s) discarded in total. max_size:" + std::to_string(task_max_size_));
+    }
+}
+
+bool eventloop::pop_task(queued_task& item)
+{
+    if (task_queue_.try_pop(item))
+    {
+        return true;
+    }
+    if (overflow_size_.load() == 0)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    if (overflow_queue_.empty())
+    {
+        return false;
+    }
+    item = std::move(overflow_queue_.front());
+    overflow_queue_.pop_front();
+    overflow_size_--;
+    return true;
+}
+
+size_t eventloop::drain_tasks()
+{
+    // 只处理本轮开始时已在队列中的任务，执行过程中新投递的任务留到下一轮处理
+    size_t count = task_count();
+    task_batch_.clear();
+    task_batch_.reserve(count);
+    // 环形队列中连续的任务一次CAS全部取出，取出后队列的空位立即可供生产者使用
+    size_t done = task_queue_.try_pop_bulk(std::back_inserter(task_batch_), count);
+    queued_task item;
+    while (done < count && pop_task(item))
+    {
+        task_batch_.emplace_back(std::move(item));
+        ++done;
+    }
+    on_tasks_consumed();
+    // 只有Loop线程写入，不需要原子的读-改-写
+    executed_tasks_.store(executed_tasks_.load(std::memory_order_relaxed) + done,
+                          std::memory_order_relaxed);
+    return done;
+}
+
+EventloopTimePoint eventloop::post_time() const
+{
+    return stats_enabled_ ? std::chrono::steady_clock::now() : EventloopTimePoint();
+}
+
+template<typename NameFunc>
+void eventloop::record_handler(EventloopTimePoint start, const NameFunc& name_func)
+{
+    auto cost = std::chrono::steady_clock::now() - start;
+    handler_time_.record(cost);
+    if (slow_threshold_ > EventloopDuration::zero() && cost >= slow_threshold_)
+    {
+        slow_handlers_.store(slow_handlers_.load(std::memory_order_relaxed) + 1,
+                             std::memory_order_relaxed);
+        if (on_slow_handler_)
+        {
+            on_slow_handler_(name_func(), cost);
+        }
+    }
+}
+
+void eventloop::set_stats_enabled(bool enabled)
 {
     if (is_running_.load())
+    {
+        CUTL_WARN("The event loop is running, the statistics switch can not be changed");
+        return;
+    }
+    stats_enabled_ = enabled;
+}
+
+void eventloop::set_slow_handler_callback(EventloopDuration threshold,
+                                          const EventloopSlowHandlerFunc& callback)
+{
+    if (is_running_.load())
+    {
+        CUTL_WARN("The event loop is running, the slow handler callback can not be changed");
+        return;
+    }
+    slow_threshold_ = threshold;
+    on_slow_handler_ = callback;
+}
+
+eventloop_stats eventloop::stats() const
+{
+    eventloop_stats result;
+    result.executed_tasks = executed_tasks_.load(std::memory_order_relaxed);
+    result.executed_timers = executed_timers_.load(std::memory_order_relaxed);
+    result.slow_handlers = slow_handlers_.load(std::memory_order_relaxed);
+    result.iterations = iterations_.load(std::memory_order_relaxed);
+    result.queue_delay = queue_delay_.snapshot();
+    result.handler_time = handler_time_.snapshot();
+    result.timer_lateness = timer_lateness_.snapshot();
+    result.loop_lag = loop_lag_.snapshot();
+    return result;
+}
+
+void eventloop::reset_stats()
+{
+    executed_tasks_.store(0);
+    executed_timers_.store(0);
+    slow_handlers_.store(0);
+    iterations_.store(0);
+    queue_delay_.reset();
+    handler_time_.reset();
+    timer_lateness_.reset();
+    loop_lag_.reset();
+}
+
+void eventloop::on_tasks_consumed()
+{
+    if (blocked_producers_.load() > 0)
+    {
+        std::lock_guard<std::mutex> lock(space_mutex_);
+        space_cv_.notify_all();
+    }
+
+    if (above_high_watermark_.load())
+    {
+        size_t size = task_count();
+        if (size <= queue_options_.low_watermark && above_high_watermark_.exchange(false) &&
+            queue_options_.on_low_watermark)
+        {
+            queue_options_.on_low_watermark(size);
+        }
+    }
+}
+
+void eventloop::start()
+{
+    // 在启动线程之前置为运行状态，避免start之后立即调用的stop被覆盖
+    if (is_running_.exchange(true))
     {
         // 重复调用
         CUTL_WARN("recursive call of start.");
@@ -172,11 +348,37 @@ void eventloop::start()
 
 bool eventloop::is_loop_thread() const
 {
-    return loop_thread_id_ == std::this_thread::get_id();
+    return loop_thread_id_.load() == std::this_thread::get_id();
 }
 
 void eventloop::wakeup()
 {
+    sleeping_.store(false);
+    notify_loop();
+}
+
+void eventloop::wakeup_if_sleeping()
+{
+    // 与loop_once中的屏障配对: 要么Loop线程在等待前看到新任务，要么这里看到sleeping_为true
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // 多个生产者同时投递时，只有一个执行唤醒
+    if (sleeping_.load(std::memory_order_relaxed) && sleeping_.exchange(false))
+    {
+        notify_loop();
+    }
+}
+
+void eventloop::notify_loop()
+{
+    if (io_poller_)
+    {
+        io_poller_->wakeup();
+        return;
+    }
+    // 加锁保证Loop线程检查完sleeping_之后、开始等待之前，通知不会丢失
+    {
+        std::lock_guard<std::mutex> lock(cv_mutex_);
+    }
     cv_wakeup_.notify_one();
 }
 
@@ -189,14 +391,117 @@ void eventloop::wait_for_timeout_or_wakeup(std::chrono::microseconds timeout)
 
     std::unique_lock<std::mutex> lock(cv_mutex_);
     EventloopTimePoint abs_timeout = std::chrono::steady_clock::now() + timeout;
-    if (cv_wakeup_.wait_until(lock, abs_timeout) == std::cv_status::timeout)
+    // 每次唤醒都会经过这里，不打印日志(避免构造日志字符串)
+    cv_wakeup_.wait_until(lock, abs_timeout, [this]() { return !sleeping_.load(); });
+}
+
+size_t eventloop::wait_for_io_events(EventloopDuration timeout)
+{
+    const auto& events = io_poller_->wait(timeout);
+    // 醒来后立即清除等待标记，执行文件描述符回调期间投递的任务不需要再唤醒Loop线程
+    sleeping_.store(false, std::memory_order_relaxed);
+    // 忙碌时间从醒来开始计算，包含下面的文件描述符回调
+    wake_time_ = post_time();
+    size_t done = 0;
+    for (const auto& event : events)
     {
-        CUTL_DEBUG("Timeout occurred!");
+        // 用户数据: 高32位为注册序号，低32位为文件描述符
+        int fd = static_cast<int>(static_cast<uint32_t>(event.data));
+        uint32_t id = static_cast<uint32_t>(event.data >> 32);
+        std::shared_ptr<fd_watcher> watcher;
+        {
+            std::lock_guard<std::mutex> lock(fd_mutex_);
+            auto itr = fd_watchers_.find(fd);
+            // 文件描述符在等待期间被移除(或移除后重新添加)时，丢弃该事件
+            if (itr == fd_watchers_.end() || itr->second->id_ != id)
+            {
+                continue;
+            }
+            watcher = itr->second;
+        }
+        // 持有watcher的引用，回调中可以安全地调用remove_fd
+        if (stats_enabled_)
+        {
+            auto start = std::chrono::steady_clock::now();
+            watcher->func_(fd, event.events);
+            record_handler(start, [fd]() { return "fd:" + std::to_string(fd); });
+        }
+        else
+        {
+            watcher->func_(fd, event.events);
+        }
+        ++done;
     }
-    else
+    return done;
+}
+
+bool eventloop::add_fd(int fd, uint32_t events, const EventloopFdFunc& callback)
+{
+    if (!io_poller_)
+    {
+        CUTL_ERROR("Watching file descriptors is not supported on this platform");
+        return false;
+    }
+    if (fd < 0 || !callback)
+    {
+        CUTL_ERROR("Invalid fd or callback, fd:" + std::to_string(fd));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(fd_mutex_);
+    if (fd_watchers_.find(fd) != fd_watchers_.end())
+    {
+        CUTL_ERROR("The fd is already watched, fd:" + std::to_string(fd));
+        return false;
+    }
+
+    auto watcher = std::make_shared<fd_watcher>();
+    watcher->fd_ = fd;
+    watcher->events_ = events;
+    watcher->id_ = ++fd_watcher_id_;
+    watcher->func_ = callback;
+    uint64_t data = (static_cast<uint64_t>(watcher->id_) << 32) | static_cast<uint32_t>(fd);
+    if (!io_poller_->add(fd, events, data))
     {
-        CUTL_DEBUG("Condition met!");
+        return false;
     }
+    fd_watchers_[fd] = watcher;
+    return true;
+}
+
+bool eventloop::modify_fd(int fd, uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(fd_mutex_);
+    auto itr = fd_watchers_.find(fd);
+    if (itr == fd_watchers_.end())
+    {
+        CUTL_ERROR("The fd is not watched, fd:" + std::to_string(fd));
+        return false;
+    }
+
+    auto& watcher = itr->second;
+    uint64_t data = (static_cast<uint64_t>(watcher->id_) << 32) | static_cast<uint32_t>(fd);
+    if (!io_poller_->modify(fd, events, data))
+    {
+        return false;
+    }
+    watcher->events_ = events;
+    return true;
+}
+
+bool eventloop::remove_fd(int fd)
+{
+    std::lock_guard<std::mutex> lock(fd_mutex_);
+    auto itr = fd_watchers_.find(fd);
+    if (itr == fd_watchers_.end())
+    {
+        CUTL_ERROR("The fd is not watched, fd:" + std::to_string(fd));
+        return false;
+    }
+    fd_watchers_.erase(itr);
+    // 文件描述符已被关闭时epoll会自动移除，这里只需要清除回调
+    io_poller_->remove(fd);
+    return true;
 }
 
 void eventloop::stop()
@@ -205,28 +510,76 @@ void eventloop::stop()
     wakeup();
 }
 
+bool eventloop::set_timer_options(const eventloop_timer_options& options)
+{
+    std::lock_guard<std::mutex> lock(timer_task_mutex_);
+    if (timer_task_queue_->size() > 0)
+    {
+        CUTL_WARN("There are timer tasks in the queue, the timer options can not be changed");
+        return false;
+    }
+
+    if (options.backend == eventloop_timer_backend::timing_wheel)
+    {
+        timer_task_queue_.reset(
+          new wheel_timer_queue(options.tick, options.wheel_slots, options.wheel_levels));
+    }
+    else
+    {
+        timer_task_queue_.reset(new heap_timer_queue());
+    }
+    return true;
+}
+
 timer_task_handler eventloop::post_timer_event(const std::string& name,
-                                               const EventloopTask& func,
+                                               const EventloopTimerFunc& func,
                                                const EventloopDuration& period,
-                                               int64_t repeat)
+                                               int64_t repeat,
+                                               eventloop_post_status* status)
 {
     {
         std::lock_guard<std::mutex> lock(timer_task_mutex_);
-        if (timer_task_queue_.size() >= timer_task_max_size_)
+        if (timer_task_queue_->size() >= timer_task_max_size_)
         {
             CUTL_ERROR("Timer task queue is full, discard task. size:" +
-                       std::to_string(timer_task_queue_.size()) +
+                       std::to_string(timer_task_queue_->size()) +
                        ", max_size:" + std::to_string(timer_task_max_size_));
+            if (status)
+            {
+                *status = eventloop_post_status::rejected;
+            }
             return timer_task_handler(nullptr);
         }
     }
+    // 在任务对Loop线程可见之前设置结果: 单次定时任务可能在返回前就已执行并释放
+    if (status)
+    {
+        *status = eventloop_post_status::success;
+    }
     auto handler = post_to_priorityqueue(name, func, period, repeat);
-    wakeup();
+    // Loop线程在计算等待时间之前已标记为等待，忙碌时会在下一轮看到新的定时任务
+    wakeup_if_sleeping();
     return handler;
 }
 
+size_t eventloop::timer_count() const
+{
+    std::lock_guard<std::mutex> lock(timer_task_mutex_);
+    return timer_task_queue_->size();
+}
+
+void eventloop::cancel_timer_task(TimerTask* task)
+{
+    cancelled_timer_count_++;
+    // 正在执行中的定时任务已不在队列中，执行完后不会被重新放入队列
+    std::lock_guard<std::mutex> lock(timer_task_mutex_);
+    timer_task_queue_->remove(task);
+}
+
 void eventloop::loop_once(EventloopDuration timeout)
 {
+    iterations_.store(iterations_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
     // 处理定时任务
     size_t timer_task_done = handle_timer_task();
     // CUTL_DEBUG(std::to_string(timer_task_done) + " timer task(s) done.");
@@ -235,30 +588,61 @@ void eventloop::loop_once(EventloopDuration timeout)
     size_t task_done = handle_task();
     // CUTL_DEBUG(std::to_string(task_done) + " task(s) done.");
 
+    // 先标记为等待状态，再检查定时任务和普通任务，与wakeup_if_sleeping配对，不会丢失唤醒
+    sleeping_.store(true);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
     // 从定时任务队列中获取离当前时间最近的定时任务的到期间隔
     EventloopDuration next_timer_task_duration = get_next_run_time();
     if (next_timer_task_duration < timeout)
     {
         timeout = next_timer_task_duration;
     }
+    // 本轮执行期间投递的任务不会唤醒Loop线程(忙碌中)，不等待直接进入下一轮
+    if (task_count() > 0)
+    {
+        timeout = EventloopDuration::zero();
+    }
 
-    wait_for_timeout_or_wakeup(std::chrono::duration_cast<std::chrono::microseconds>(timeout));
+    // 本轮从醒来(包括文件描述符回调)到再次等待的忙碌时间，即新事件最多需要等待多久才会被处理
+    if (stats_enabled_)
+    {
+        loop_lag_.record(std::chrono::steady_clock::now() - wake_time_);
+    }
+
+    if (io_poller_)
+    {
+        // 在其中清除sleeping_
+        wait_for_io_events(timeout);
+    }
+    else
+    {
+        wait_for_timeout_or_wakeup(std::chrono::duration_cast<std::chrono::microseconds>(timeout));
+        sleeping_.store(false, std::memory_order_relaxed);
+        wake_time_ = post_time();
+    }
 }
 
 size_t eventloop::handle_task()
 {
-    std::list<EventloopTask> tasks;
-    {
-        std::lock_guard<std::mutex> guard(task_mutex_);
-        // swap后，task_queue_变成了空队列，tasks获取到了所有队列元素
-        tasks.swap(task_queue_);
-    }
+    static const std::string task_name("task");
 
-    for (const auto& task : tasks)
+    size_t done = drain_tasks();
+    for (auto& item : task_batch_)
     {
-        task();
+        if (!stats_enabled_)
+        {
+            item.task();
+            continue;
+        }
+        auto start = std::chrono::steady_clock::now();
+        queue_delay_.record(start - item.post_time);
+        item.task();
+        record_handler(start, []() { return task_name; });
     }
-    return tasks.size();
+    // 执行完后释放任务持有的资源，保留内存供下一轮复用
+    task_batch_.clear();
+    return done;
 }
 
 size_t eventloop::handle_timer_task()
@@ -278,10 +662,22 @@ size_t eventloop::handle_timer_task()
 
         // CUTL_INFO("[" + task->name_ + "]left_times:" +
         // std::to_string(task->left_times_.load()));
-        task->func_();
+        if (stats_enabled_)
+        {
+            auto start = std::chrono::steady_clock::now();
+            timer_lateness_.record(start - task->next_run_time_);
+            task->func_();
+            record_handler(start, [&task]() { return task->name_; });
+        }
+        else
+        {
+            task->func_();
+        }
         task->update_left_times();
         ++done;
     }
+    executed_timers_.store(executed_timers_.load(std::memory_order_relaxed) + done,
+                           std::memory_order_relaxed);
 
     // 再获取一次 now，因为上面可能比较耗时
     now = std::chrono::steady_clock::now();
@@ -295,7 +691,7 @@ size_t eventloop::handle_timer_task()
             continue;
         }
         task->update_next_run_time(now);
-        timer_task_queue_.emplace(task);
+        timer_task_queue_->push(task);
     }
 
     return done;
@@ -303,8 +699,8 @@ size_t eventloop::handle_timer_task()
 
 void eventloop::start_loop()
 {
-    is_running_.store(true);
-    loop_thread_id_ = std::this_thread::get_id();
+    loop_thread_id_.store(std::this_thread::get_id());
+    wake_time_ = post_time();
 
     while (is_running_.load())
     {
@@ -316,55 +712,30 @@ eventloop::TimerTaskVec eventloop::get_expired_timer_tasks(EventloopTimePoint no
 {
     std::vector<TimerTaskPtr> ready_tasks;
     std::lock_guard<std::mutex> lock(timer_task_mutex_);
-    while (!timer_task_queue_.empty())
-    {
-        TimerTaskPtr timerTask = timer_task_queue_.top();
-
-        // auto task_run_time = fmt_timepoint(timerTask->next_run_time_);
-        // auto not_time = fmt_timepoint(now);
-        // CUTL_INFO("[" + timerTask->name_ + " : " + std::to_string(count) +
-        //           "] run_time: " + task_run_time + ", now_time:" + not_time);
-
-        // 最小堆的堆顶元素(任务)的执行时间大于当前时间，说明堆内所有任务均未就绪(未到执行时间)
-        if (timerTask->next_run_time_ > now)
-        {
-            break;
-        }
-        timer_task_queue_.pop();
-        ready_tasks.emplace_back(std::move(timerTask));
-    }
+    timer_task_queue_->pop_expired(now, ready_tasks);
     return ready_tasks;
 }
 
 timer_task_handler eventloop::post_to_priorityqueue(const std::string& name,
-                                                    const EventloopTask& func,
+                                                    const EventloopTimerFunc& func,
                                                     const EventloopDuration& period,
                                                     int repeat)
 {
 
     auto now = std::chrono::steady_clock::now();
-    auto task = std::make_shared<TimerTask>(name, now + period, period, func, repeat);
+    // 不使用make_shared: timer_task_handler的弱引用会使make_shared分配的内存在任务销毁后仍无法释放
+    auto task = TimerTaskPtr(new TimerTask(this, name, now + period, period, func, repeat));
 
     std::lock_guard<std::mutex> lock(timer_task_mutex_);
-    timer_task_queue_.emplace(task);
+    timer_task_queue_->push(task);
     return cutl::timer_task_handler(task);
 }
 
 EventloopDuration eventloop::get_next_run_time()
 {
-    // using namespace std::chrono_literals;
     auto now = std::chrono::steady_clock::now();
     std::lock_guard<std::mutex> lock(timer_task_mutex_);
-    if (timer_task_queue_.empty())
-    {
-        return std::chrono::seconds(1);
-    }
-
-    if (timer_task_queue_.top()->next_run_time_ <= now)
-    {
-        return EventloopDuration::zero();
-    }
-    return timer_task_queue_.top()->next_run_time_ - now;
+    return timer_task_queue_->next_timeout(now, std::chrono::seconds(1));
 }
 
 singlethread_eventloop::singlethread_eventloop(const std::string thread_name,
@@ -375,9 +746,21 @@ singlethread_eventloop::singlethread_eventloop(const std::string thread_name,
 {
 }
 
-void singlethread_eventloop::start()
+void singlethread_eventloop::set_placement(const thread_placement& placement, uint32_t index)
 {
     if (is_running_.load())
+    {
+        CUTL_WARN("The event loop is running, the placement can not be changed");
+        return;
+    }
+    placement_ = placement;
+    placement_index_ = index;
+}
+
+void singlethread_eventloop::start()
+{
+    // 在启动线程之前置为运行状态，避免start之后立即调用的stop被覆盖
+    if (is_running_.exchange(true))
     {
         // 重复调用
         CUTL_WARN("recursive call of start.");
@@ -389,6 +772,7 @@ void singlethread_eventloop::start()
       [this]()
       {
           cutl::set_current_thread_name(thread_name_);
+          apply_thread_placement(placement_, placement_index_);
           start_loop();
       });
 }
@@ -417,7 +801,8 @@ multithread_eventloop::~multithread_eventloop() {}
 
 void multithread_eventloop::start()
 {
-    if (is_running_.load())
+    // 在启动线程之前置为运行状态，避免start之后立即调用的stop被覆盖
+    if (is_running_.exchange(true))
     {
         // 重复调用
         CUTL_WARN("recursive call of start.");
@@ -436,18 +821,18 @@ void multithread_eventloop::stop()
 
 size_t multithread_eventloop::handle_task()
 {
-    std::list<EventloopTask> tasks;
-    {
-        std::lock_guard<std::mutex> guard(task_mutex_);
-        // swap后，task_queue_变成了空队列，tasks获取到了所有队列元素
-        tasks.swap(task_queue_);
-    }
-
-    for (const auto& task : tasks)
+    size_t done = drain_tasks();
+    auto now = post_time();
+    for (auto& item : task_batch_)
     {
-        thread_pool_.add_task(task);
+        if (stats_enabled_)
+        {
+            queue_delay_.record(now - item.post_time);
+        }
+        thread_pool_.add_task(std::move(item.task));
     }
-    return tasks.size();
+    task_batch_.clear();
+    return done;
 }
 
 size_t multithread_eventloop::handle_timer_task()
@@ -465,10 +850,16 @@ size_t multithread_eventloop::handle_timer_task()
             continue;
         }
 
+        if (stats_enabled_)
+        {
+            timer_lateness_.record(now - task->next_run_time_);
+        }
         thread_pool_.add_task(task->func_);
         task->update_left_times();
         ++done;
     }
+    executed_timers_.store(executed_timers_.load(std::memory_order_relaxed) + done,
+                           std::memory_order_relaxed);
 
     // 再获取一次 now，因为上面可能比较耗时
     now = std::chrono::steady_clock::now();
@@ -482,10 +873,102 @@ size_t multithread_eventloop::handle_timer_task()
             continue;
         }
         task->update_next_run_time(now);
-        timer_task_queue_.emplace(task);
+        timer_task_queue_->push(task);
     }
 
     return done;
 }
 
+eventloop_group::eventloop_group(const std::string& name,
+                                 uint32_t loop_num,
+                                 uint32_t task_max_size,
+                                 uint32_t timer_task_max_size)
+  : next_index_(0)
+{
+    if (loop_num == 0)
+    {
+        loop_num = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+    loops_.reserve(loop_num);
+    for (uint32_t i = 0; i < loop_num; i++)
+    {
+        loops_.emplace_back(new singlethread_eventloop(
+          name + "-" + std::to_string(i), task_max_size, timer_task_max_size));
+    }
+}
+
+eventloop_group::~eventloop_group()
+{
+    stop();
+}
+
+void eventloop_group::set_placement(const thread_placement& placement)
+{
+    for (uint32_t i = 0; i < loops_.size(); i++)
+    {
+        loops_[i]->set_placement(placement, i);
+    }
+}
+
+void eventloop_group::start()
+{
+    for (auto& loop : loops_)
+    {
+        loop->start();
+    }
+}
+
+void eventloop_group::stop()
+{
+    for (auto& loop : loops_)
+    {
+        loop->stop();
+    }
+}
+
+singlethread_eventloop& eventloop_group::next_loop(eventloop_balance policy)
+{
+    if (policy == eventloop_balance::least_loaded)
+    {
+        // 从轮询的位置开始查找，任务数相同时各事件循环被均匀选中
+        uint32_t start = next_index_.fetch_add(1, std::memory_order_relaxed);
+        uint32_t best = start % size();
+        size_t best_count = loops_[best]->task_count();
+        for (uint32_t i = 1; i < size() && best_count > 0; i++)
+        {
+            uint32_t index = (start + i) % size();
+            size_t count = loops_[index]->task_count();
+            if (count < best_count)
+            {
+                best = index;
+                best_count = count;
+            }
+        }
+        return *loops_[best];
+    }
+
+    return *loops_[next_index_.fetch_add(1, std::memory_order_relaxed) % size()];
+}
+
+eventloop_post_status eventloop_group::post_event(EventloopTask&& task, eventloop_balance policy)
+{
+    return next_loop(policy).post_event(std::move(task));
+}
+
+timer_task_handler eventloop_group::post_timer_event(const std::string& name,
+                                                     const EventloopTimerFunc& func,
+                                                     const EventloopDuration& period,
+                                                     int64_t repeat,
+                                                     eventloop_post_status* status)
+{
+    return next_loop().post_timer_event(name, func, period, repeat, status);
+}
+
+uint32_t eventloop_group::hash_to_index(size_t hash) const
+{
+    // std::hash对整数通常是恒等映射，先打散再取模，避免有规律的key集中在少数事件循环上
+    uint64_t mixed = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+    return static_cast<uint32_t>((mixed >> 32) % size());
+}
+
 } // namespace cutl
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "eventloop.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace cutl
+{
+
+    // 被事件循环监听的文件描述符
+    struct fd_watcher
+    {
+        int fd_;
+        // 监听的事件，fd_event_read | fd_event_write
+        uint32_t events_;
+        // 注册序号，用于识别文件描述符被移除后又重新添加(复用)的情况
+        uint32_t id_;
+        EventloopFdFunc func_;
+    };
+
+    // 就绪的IO事件
+    struct io_event
+    {
+        // 注册时传入的用户数据
+        uint64_t data;
+        // 就绪的事件，fd_event_read | fd_event_write | fd_event_error
+        uint32_t events;
+    };
+
+    // IO多路复用器，同时负责事件循环的唤醒和等待超时
+    // add/modify/remove/wakeup可以在任意线程调用，wait只在事件循环线程调用
+    class io_poller
+    {
+    public:
+        virtual ~io_poller() = default;
+
+        virtual bool add(int fd, uint32_t events, uint64_t data) = 0;
+        virtual bool modify(int fd, uint32_t events, uint64_t data) = 0;
+        virtual bool remove(int fd) = 0;
+        // 等待IO事件、唤醒或超时，返回就绪的IO事件(不包含唤醒和定时器事件)
+        virtual const std::vector<io_event>& wait(EventloopDuration timeout) = 0;
+        // 唤醒阻塞在wait中的线程，wait之前的唤醒不会丢失
+        virtual void wakeup() = 0;
+    };
+
+    // 创建当前平台的IO多路复用器，不支持的平台返回nullptr(事件循环退化为条件变量等待)
+    std::unique_ptr<io_poller> create_io_poller();
+
+} // namespace cutl
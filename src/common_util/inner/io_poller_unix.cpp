@@ -0,0 +1,262 @@
+#if defined(_WIN32)
+// do nothing
+#else
+
+#include "inner/logger.h"
+#include "io_poller.h"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+namespace cutl
+{
+
+#if defined(__linux__)
+
+    // 基于epoll的IO多路复用器(水平触发)
+    // 唤醒使用eventfd；等待时间不是整毫秒时使用timerfd，避免epoll_wait的毫秒精度使定时任务延迟
+    class epoll_poller : public io_poller
+    {
+    public:
+        epoll_poller()
+          : epoll_fd_(-1)
+          , event_fd_(-1)
+          , timer_fd_(-1)
+          , timer_armed_(false)
+          , buffer_(64)
+        {
+        }
+
+        ~epoll_poller() override
+        {
+            for (int fd : { timer_fd_, event_fd_, epoll_fd_ })
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+            }
+        }
+
+        bool init()
+        {
+            epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd_ < 0)
+            {
+                CUTL_ERROR("epoll_create1 failed: " + std::string(strerror(errno)));
+                return false;
+            }
+
+            event_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (event_fd_ < 0 || !ctl(EPOLL_CTL_ADD, event_fd_, EPOLLIN, wakeup_data))
+            {
+                CUTL_ERROR("create eventfd failed: " + std::string(strerror(errno)));
+                return false;
+            }
+
+            // timerfd只用于提高等待超时的精度，创建失败时不影响使用
+            timer_fd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (timer_fd_ >= 0 && !ctl(EPOLL_CTL_ADD, timer_fd_, EPOLLIN, timer_data))
+            {
+                ::close(timer_fd_);
+                timer_fd_ = -1;
+            }
+            return true;
+        }
+
+        bool add(int fd, uint32_t events, uint64_t data) override
+        {
+            return ctl(EPOLL_CTL_ADD, fd, to_epoll_events(events), data);
+        }
+
+        bool modify(int fd, uint32_t events, uint64_t data) override
+        {
+            return ctl(EPOLL_CTL_MOD, fd, to_epoll_events(events), data);
+        }
+
+        bool remove(int fd) override { return ctl(EPOLL_CTL_DEL, fd, 0, 0); }
+
+        const std::vector<io_event>& wait(EventloopDuration timeout) override
+        {
+            ready_.clear();
+
+            int n = ::epoll_wait(epoll_fd_, buffer_.data(), static_cast<int>(buffer_.size()),
+                                 to_timeout_ms(timeout));
+            // 因其它事件提前返回时取消未到期的timerfd，避免它在之后的等待中造成多余的唤醒
+            disarm_timer();
+            if (n < 0)
+            {
+                if (errno != EINTR)
+                {
+                    CUTL_ERROR("epoll_wait failed: " + std::string(strerror(errno)));
+                }
+                return ready_;
+            }
+
+            for (int i = 0; i < n; i++)
+            {
+                const auto& ev = buffer_[i];
+                if (ev.data.u64 == wakeup_data || ev.data.u64 == timer_data)
+                {
+                    // 读取计数，清除就绪状态
+                    int fd = ev.data.u64 == wakeup_data ? event_fd_ : timer_fd_;
+                    uint64_t value = 0;
+                    ssize_t ret = ::read(fd, &value, sizeof(value));
+                    (void)ret;
+                    continue;
+                }
+                ready_.push_back(io_event{ ev.data.u64, from_epoll_events(ev.events) });
+            }
+
+            // 缓冲区被填满时扩容，以便下次一次取出更多的事件
+            if (static_cast<size_t>(n) == buffer_.size())
+            {
+                buffer_.resize(buffer_.size() * 2);
+            }
+            return ready_;
+        }
+
+        void wakeup() override
+        {
+            uint64_t one = 1;
+            // 计数溢出(EAGAIN)时说明已经处于唤醒状态，忽略即可
+            ssize_t ret = ::write(event_fd_, &one, sizeof(one));
+            (void)ret;
+        }
+
+    private:
+        // 唤醒和定时器的用户数据，低32位不是合法的文件描述符，不会与注册的文件描述符冲突
+        static constexpr uint64_t wakeup_data = ~static_cast<uint64_t>(0);
+        static constexpr uint64_t timer_data = ~static_cast<uint64_t>(0) - 1;
+
+        bool ctl(int op, int fd, uint32_t events, uint64_t data)
+        {
+            struct epoll_event ev;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = events;
+            ev.data.u64 = data;
+            if (::epoll_ctl(epoll_fd_, op, fd, &ev) != 0)
+            {
+                // 已关闭的文件描述符会被epoll自动移除
+                if (op == EPOLL_CTL_DEL && (errno == EBADF || errno == ENOENT))
+                {
+                    return true;
+                }
+                CUTL_ERROR("epoll_ctl failed, fd:" + std::to_string(fd) +
+                           ", op:" + std::to_string(op) + ", error:" + std::string(strerror(errno)));
+                return false;
+            }
+            return true;
+        }
+
+        void disarm_timer()
+        {
+            if (!timer_armed_)
+            {
+                return;
+            }
+            // 重新设置时同时清除已到期但未读取的计数
+            struct itimerspec spec;
+            memset(&spec, 0, sizeof(spec));
+            ::timerfd_settime(timer_fd_, 0, &spec, nullptr);
+            timer_armed_ = false;
+        }
+
+        int to_timeout_ms(EventloopDuration timeout)
+        {
+            if (timeout <= EventloopDuration::zero())
+            {
+                return 0;
+            }
+
+            // 向上取整，保证不会提前超时
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(timeout);
+            if (ms < timeout)
+            {
+                // 不是整毫秒时，用timerfd在精确的时间点唤醒
+                if (timer_fd_ >= 0)
+                {
+                    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(timeout).count();
+                    struct itimerspec spec;
+                    memset(&spec, 0, sizeof(spec));
+                    spec.it_value.tv_sec = static_cast<time_t>(ns / 1000000000);
+                    spec.it_value.tv_nsec = static_cast<long>(ns % 1000000000);
+                    timer_armed_ = ::timerfd_settime(timer_fd_, 0, &spec, nullptr) == 0;
+                }
+                ms += std::chrono::milliseconds(1);
+            }
+            return ms.count() > INT_MAX ? INT_MAX : static_cast<int>(ms.count());
+        }
+
+        static uint32_t to_epoll_events(uint32_t events)
+        {
+            uint32_t result = 0;
+            if (events & fd_event_read)
+            {
+                result |= EPOLLIN | EPOLLRDHUP;
+            }
+            if (events & fd_event_write)
+            {
+                result |= EPOLLOUT;
+            }
+            return result;
+        }
+
+        static uint32_t from_epoll_events(uint32_t events)
+        {
+            uint32_t result = 0;
+            if (events & (EPOLLIN | EPOLLPRI))
+            {
+                result |= fd_event_read;
+            }
+            if (events & EPOLLOUT)
+            {
+                result |= fd_event_write;
+            }
+            if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            {
+                result |= fd_event_error;
+            }
+            return result;
+        }
+
+    private:
+        int epoll_fd_;
+        int event_fd_;
+        int timer_fd_;
+        // timerfd是否已设置(等待返回后取消)
+        bool timer_armed_;
+        std::vector<struct epoll_event> buffer_;
+        std::vector<io_event> ready_;
+    };
+
+    std::unique_ptr<io_poller> create_io_poller()
+    {
+        std::unique_ptr<epoll_poller> poller(new epoll_poller());
+        if (!poller->init())
+        {
+            return nullptr;
+        }
+        return poller;
+    }
+
+#else
+
+    std::unique_ptr<io_poller> create_io_poller()
+    {
+        // 暂不支持kqueue
+        return nullptr;
+    }
+
+#endif
+
+} // namespace cutl
+
+#endif // defined(_WIN32)
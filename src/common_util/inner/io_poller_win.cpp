@@ -0,0 +1,16 @@
+#if defined(_WIN32)
+
+#include "io_poller.h"
+
+namespace cutl
+{
+
+    std::unique_ptr<io_poller> create_io_poller()
+    {
+        // 暂不支持IOCP，事件循环使用条件变量等待
+        return nullptr;
+    }
+
+} // namespace cutl
+
+#endif // defined(_WIN32)
@@ -0,0 +1,355 @@
+#include "timer_queue.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace cutl
+{
+
+    TimerTask::TimerTask(eventloop* owner,
+                         const std::string& name,
+                         const EventloopTimePoint& next_run_time,
+                         const EventloopDuration& period,
+                         const EventloopTimerFunc& func,
+                         int64_t repeat_times)
+      : name_(name)
+      , next_run_time_(next_run_time)
+      , period_(period)
+      , func_(func)
+      , left_times_(repeat_times)
+      , owner_(owner)
+      , queue_index_(npos)
+      , expire_tick_(0)
+      , wheel_slot_(0)
+    {
+    }
+
+    bool TimerTask::cancel()
+    {
+        // 大量取消(如请求超时)时，不逐个打印警告日志
+        bool valid = left_times_.exchange(0) != 0;
+        CUTL_DEBUG("TimerTask[" + name_ + "] is canceled.");
+        return valid;
+    }
+
+    void TimerTask::update_left_times()
+    {
+        if (left_times_.load() > 0)
+        {
+            left_times_.store(left_times_.load() - 1);
+        }
+    }
+
+    void TimerTask::update_next_run_time(EventloopTimePoint now)
+    {
+        next_run_time_ += period_;
+        if (next_run_time_ < now)
+        {
+            // 当前时间超出期望(的执行)时间至少一个周期，则调整期望的执行时间
+            if (now - next_run_time_ > period_)
+            {
+                auto delta =
+                  std::chrono::duration_cast<std::chrono::nanoseconds>(next_run_time_ - now)
+                    .count();
+                int period_ns = period_.count();
+                CUTL_WARN("TimerTask[" + name_ +
+                          "] The current time exceeds the expected time by at least one period_[" +
+                          std::to_string(period_ns) + "ns]. Delta: " + std::to_string(delta) +
+                          "ns");
+
+                next_run_time_ = now;
+            }
+        }
+    }
+
+    // 定时任务队列的比较函数: 定义最小堆
+    bool TimerTaskCompare(const TimerTaskPtr& a, const TimerTaskPtr& b)
+    {
+        // a > b: 表示最小堆
+        return *b < *a;
+    }
+
+    void heap_timer_queue::push(const TimerTaskPtr& task)
+    {
+        heap_.emplace_back(nullptr);
+        set(heap_.size() - 1, task);
+        sift_up(heap_.size() - 1);
+    }
+
+    bool heap_timer_queue::remove(TimerTask* task)
+    {
+        size_t index = task->queue_index_;
+        if (index >= heap_.size() || heap_[index].get() != task)
+        {
+            return false;
+        }
+        remove_at(index);
+        return true;
+    }
+
+    void heap_timer_queue::pop_expired(EventloopTimePoint now, eventloop::TimerTaskVec& ready)
+    {
+        // 堆顶元素(任务)的执行时间大于当前时间，说明堆内所有任务均未就绪(未到执行时间)
+        while (!heap_.empty() && heap_.front()->next_run_time_ <= now)
+        {
+            ready.emplace_back(remove_at(0));
+        }
+    }
+
+    TimerTaskPtr heap_timer_queue::remove_at(size_t index)
+    {
+        TimerTaskPtr task = std::move(heap_[index]);
+        task->queue_index_ = TimerTask::npos;
+        size_t last = heap_.size() - 1;
+        if (index != last)
+        {
+            set(index, std::move(heap_[last]));
+            heap_.pop_back();
+            // 移入的元素可能需要上移或下移
+            sift_up(index);
+            sift_down(heap_[index]->queue_index_);
+        }
+        else
+        {
+            heap_.pop_back();
+        }
+        return task;
+    }
+
+    void heap_timer_queue::sift_up(size_t index)
+    {
+        TimerTaskPtr task = std::move(heap_[index]);
+        while (index > 0)
+        {
+            size_t parent = (index - 1) / 2;
+            if (!(*task < *heap_[parent]))
+            {
+                break;
+            }
+            set(index, std::move(heap_[parent]));
+            index = parent;
+        }
+        set(index, std::move(task));
+    }
+
+    void heap_timer_queue::sift_down(size_t index)
+    {
+        size_t size = heap_.size();
+        TimerTaskPtr task = std::move(heap_[index]);
+        while (true)
+        {
+            size_t child = index * 2 + 1;
+            if (child >= size)
+            {
+                break;
+            }
+            if (child + 1 < size && *heap_[child + 1] < *heap_[child])
+            {
+                child++;
+            }
+            if (!(*heap_[child] < *task))
+            {
+                break;
+            }
+            set(index, std::move(heap_[child]));
+            index = child;
+        }
+        set(index, std::move(task));
+    }
+
+    void heap_timer_queue::set(size_t index, TimerTaskPtr task)
+    {
+        task->queue_index_ = index;
+        heap_[index] = std::move(task);
+    }
+
+    EventloopDuration heap_timer_queue::next_timeout(EventloopTimePoint now,
+                                                     EventloopDuration default_timeout) const
+    {
+        if (heap_.empty())
+        {
+            return default_timeout;
+        }
+        if (heap_.front()->next_run_time_ <= now)
+        {
+            return EventloopDuration::zero();
+        }
+        return heap_.front()->next_run_time_ - now;
+    }
+
+    wheel_timer_queue::wheel_timer_queue(EventloopDuration tick, uint32_t slots, uint32_t levels)
+      : start_time_(std::chrono::steady_clock::now())
+      , tick_(tick > EventloopDuration::zero() ? tick : std::chrono::milliseconds(1))
+      , slot_bits_(1)
+      , levels_(std::max(levels, 1U))
+      , current_tick_(0)
+      , count_(0)
+    {
+        // 每层的槽位数取2的幂，便于用位运算计算槽位
+        while ((1U << slot_bits_) < slots && slot_bits_ < 16)
+        {
+            slot_bits_++;
+        }
+        // 所有层的tick范围不超过64位
+        levels_ = std::min(levels_, 63 / slot_bits_);
+        slot_mask_ = (static_cast<uint64_t>(1) << slot_bits_) - 1;
+        slots_.resize(levels_ * (slot_mask_ + 1) + 1);
+    }
+
+    uint64_t wheel_timer_queue::to_tick(EventloopTimePoint time_point) const
+    {
+        if (time_point <= start_time_)
+        {
+            return 0;
+        }
+        auto elapsed = time_point - start_time_;
+        return static_cast<uint64_t>((elapsed + tick_ - EventloopDuration(1)) / tick_);
+    }
+
+    EventloopTimePoint wheel_timer_queue::to_time_point(uint64_t tick) const
+    {
+        return start_time_ + tick_ * tick;
+    }
+
+    void wheel_timer_queue::push(const TimerTaskPtr& task)
+    {
+        task->expire_tick_ = to_tick(task->next_run_time_);
+        count_++;
+        // 第0层的当前槽位已处理，到期tick不晚于当前tick的任务放入已过期的槽位
+        if (task->expire_tick_ <= current_tick_)
+        {
+            place_in_slot(task, static_cast<uint32_t>(slots_.size() - 1));
+            return;
+        }
+        place(task);
+    }
+
+    bool wheel_timer_queue::remove(TimerTask* task)
+    {
+        if (task->queue_index_ == TimerTask::npos || task->wheel_slot_ >= slots_.size())
+        {
+            return false;
+        }
+        auto& vec = slots_[task->wheel_slot_];
+        size_t index = task->queue_index_;
+        if (index >= vec.size() || vec[index].get() != task)
+        {
+            return false;
+        }
+
+        // 与槽位中的最后一个元素交换后删除，复杂度O(1)
+        if (index != vec.size() - 1)
+        {
+            vec[index] = std::move(vec.back());
+            vec[index]->queue_index_ = index;
+        }
+        vec.pop_back();
+        task->queue_index_ = TimerTask::npos;
+        count_--;
+        return true;
+    }
+
+    void wheel_timer_queue::place(const TimerTaskPtr& task)
+    {
+        uint32_t slot = static_cast<uint32_t>(slots_.size() - 1);
+        uint64_t expire = task->expire_tick_;
+        if (expire >= current_tick_)
+        {
+            // 选择能容纳到期间隔的最低层，超出最高层范围的任务暂放在最高层
+            uint64_t delta = expire - current_tick_;
+            uint32_t level = 0;
+            while (level + 1 < levels_ && (delta >> (slot_bits_ * (level + 1))) != 0)
+            {
+                level++;
+            }
+            if (level + 1 == levels_ && (delta >> (slot_bits_ * levels_)) != 0)
+            {
+                expire = current_tick_ + (static_cast<uint64_t>(1) << (slot_bits_ * levels_)) - 1;
+            }
+            slot = static_cast<uint32_t>(level * (slot_mask_ + 1) +
+                                         ((expire >> (slot_bits_ * level)) & slot_mask_));
+        }
+        // expire < current_tick_: 已过期，放入最后一个槽位，下次pop_expired时取出
+        place_in_slot(task, slot);
+    }
+
+    void wheel_timer_queue::place_in_slot(const TimerTaskPtr& task, uint32_t slot)
+    {
+        auto& vec = slots_[slot];
+        task->wheel_slot_ = slot;
+        task->queue_index_ = vec.size();
+        vec.emplace_back(task);
+    }
+
+    bool wheel_timer_queue::cascade(uint32_t level)
+    {
+        uint64_t index = (current_tick_ >> (slot_bits_ * level)) & slot_mask_;
+        eventloop::TimerTaskVec tasks;
+        tasks.swap(slots_[level * (slot_mask_ + 1) + index]);
+        for (auto& task : tasks)
+        {
+            place(task);
+        }
+        // 当前层转完一圈时，继续下移更高一层的任务
+        return index == 0;
+    }
+
+    void wheel_timer_queue::pop_expired(EventloopTimePoint now, eventloop::TimerTaskVec& ready)
+    {
+        auto collect = [this, &ready](eventloop::TimerTaskVec& vec)
+        {
+            count_ -= vec.size();
+            for (auto& task : vec)
+            {
+                task->queue_index_ = TimerTask::npos;
+                ready.emplace_back(std::move(task));
+            }
+            vec.clear();
+        };
+
+        // 已过期的任务
+        collect(slots_.back());
+
+        uint64_t target = now > start_time_ ? (now - start_time_) / tick_ : 0;
+        while (current_tick_ < target)
+        {
+            if (count_ == 0)
+            {
+                // 没有定时任务时直接跳到目标tick
+                current_tick_ = target;
+                break;
+            }
+
+            current_tick_++;
+            if ((current_tick_ & slot_mask_) == 0)
+            {
+                for (uint32_t level = 1; level < levels_ && cascade(level); level++)
+                {
+                }
+            }
+            collect(slots_[current_tick_ & slot_mask_]);
+        }
+    }
+
+    EventloopDuration wheel_timer_queue::next_timeout(EventloopTimePoint now,
+                                                      EventloopDuration default_timeout) const
+    {
+        if (count_ == 0)
+        {
+            return default_timeout;
+        }
+        if (!slots_.back().empty())
+        {
+            return EventloopDuration::zero();
+        }
+
+        // 找到第0层中下一个非空的槽位，或者下一次下移(cascade)的时间点
+        uint64_t tick = current_tick_ + 1;
+        while (slots_[tick & slot_mask_].empty() && (tick & slot_mask_) != 0)
+        {
+            tick++;
+        }
+        auto time_point = to_time_point(tick);
+        return time_point > now ? time_point - now : EventloopDuration::zero();
+    }
+
+} // namespace cutl
@@ -0,0 +1,131 @@
+#pragma once
+
+#include "eventloop.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace cutl
+{
+
+    struct TimerTask
+    {
+        // 不在定时任务队列中时queue_index_的值
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        TimerTask(eventloop* owner,
+                  const std::string& name,
+                  const EventloopTimePoint& next_run_time,
+                  const EventloopDuration& period,
+                  const EventloopTimerFunc& func,
+                  int64_t repeat_times);
+
+        bool is_valid() const { return left_times_.load() != 0; }
+        // 标记为取消，返回false表示之前已经失效
+        bool cancel();
+        void update_left_times();
+        void update_next_run_time(EventloopTimePoint now);
+
+        bool operator<(const TimerTask& other) const { return next_run_time_ < other.next_run_time_; }
+
+        // 名称
+        std::string name_;
+        // 触发时间
+        EventloopTimePoint next_run_time_;
+        // 任务的轮训周期
+        EventloopDuration period_;
+        // 任务
+        EventloopTimerFunc func_;
+        // 剩余的执行次数（-1: 表示无限循环）
+        std::atomic<int64_t> left_times_;
+        // 所属的事件循环，取消时从其定时任务队列中移除
+        eventloop* owner_;
+        // 在定时任务队列中的下标(堆的下标，或时间轮槽位中的下标)，不在队列中时为npos
+        size_t queue_index_;
+        // 时间轮: 到期的tick 和 所在的槽位
+        uint64_t expire_tick_;
+        uint32_t wheel_slot_;
+    };
+
+    // 定时任务队列，由eventloop的timer_task_mutex_保护，不需要内部加锁
+    class timer_queue
+    {
+    public:
+        virtual ~timer_queue() = default;
+
+        // 添加定时任务，按task->next_run_time_排序
+        virtual void push(const TimerTaskPtr& task) = 0;
+        // 移除定时任务，复杂度为O(1)(时间轮)或O(log n)(堆)，返回false表示任务不在队列中
+        virtual bool remove(TimerTask* task) = 0;
+        // 取出所有到期(next_run_time_ <= now)的定时任务
+        virtual void pop_expired(EventloopTimePoint now, eventloop::TimerTaskVec& ready) = 0;
+        // 距离下一个定时任务到期(或需要处理)的时间，队列为空时返回default_timeout
+        virtual EventloopDuration next_timeout(EventloopTimePoint now,
+                                               EventloopDuration default_timeout) const = 0;
+        // 定时任务的个数
+        virtual size_t size() const = 0;
+    };
+
+    // 基于最小堆的定时任务队列，插入、取出和移除的复杂度为O(log n)
+    // 任务记录自己在堆中的下标(索引堆)，取消时可以直接移除
+    class heap_timer_queue : public timer_queue
+    {
+    public:
+        void push(const TimerTaskPtr& task) override;
+        bool remove(TimerTask* task) override;
+        void pop_expired(EventloopTimePoint now, eventloop::TimerTaskVec& ready) override;
+        EventloopDuration next_timeout(EventloopTimePoint now,
+                                       EventloopDuration default_timeout) const override;
+        size_t size() const override { return heap_.size(); }
+
+    private:
+        // 移除下标为index的元素，返回被移除的元素
+        TimerTaskPtr remove_at(size_t index);
+        void sift_up(size_t index);
+        void sift_down(size_t index);
+        void set(size_t index, TimerTaskPtr task);
+
+    private:
+        eventloop::TimerTaskVec heap_;
+    };
+
+    // 分层时间轮，插入的复杂度为O(1)，每个tick只处理到期的槽位
+    // 第0层每个槽位为1个tick，第i层每个槽位为slots^i个tick，超出范围的任务放在最高层，
+    // 随着时间推进逐层下移(cascade)，直到落入第0层的槽位后到期。
+    class wheel_timer_queue : public timer_queue
+    {
+    public:
+        wheel_timer_queue(EventloopDuration tick, uint32_t slots, uint32_t levels);
+
+        void push(const TimerTaskPtr& task) override;
+        bool remove(TimerTask* task) override;
+        void pop_expired(EventloopTimePoint now, eventloop::TimerTaskVec& ready) override;
+        EventloopDuration next_timeout(EventloopTimePoint now,
+                                       EventloopDuration default_timeout) const override;
+        size_t size() const override { return count_; }
+
+    private:
+        // 时间点对应的tick，向上取整保证定时任务不会提前到期
+        uint64_t to_tick(EventloopTimePoint time_point) const;
+        EventloopTimePoint to_time_point(uint64_t tick) const;
+        // 将定时任务放入expire_tick_对应的槽位
+        void place(const TimerTaskPtr& task);
+        void place_in_slot(const TimerTaskPtr& task, uint32_t slot);
+        // 将第level层当前槽位中的任务下移到低层
+        bool cascade(uint32_t level);
+
+    private:
+        EventloopTimePoint start_time_;
+        EventloopDuration tick_;
+        uint32_t slot_bits_;
+        uint64_t slot_mask_;
+        uint32_t levels_;
+        // 当前已处理到的tick
+        uint64_t current_tick_;
+        // 所有层的槽位: levels_ * (slot_mask_ + 1)，最后一个槽位存放已过期的任务
+        std::vector<eventloop::TimerTaskVec> slots_;
+        size_t count_;
+    };
+
+} // namespace cutl
@@ -20,54 +20,209 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace cutl
 {
 
+#if __cplusplus >= 201703L
+/**
+ * @brief A transparent hash function for the string keys, to look up a
+ * lru_cache<std::string, V, string_hash, std::equal_to<>> by std::string_view or const char*
+ * without constructing a temporary std::string. Requires C++17 (C++20 for the lookup without the
+ * temporary key).
+ *
+ */
+struct string_hash
+{
+    using is_transparent = void;
+
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view>()(str); }
+};
+#endif
+
+/**
+ * @brief Why an element is removed from a lru_cache, passed to the removal listener.
+ *
+ */
+enum class lru_removal_cause
+{
+    /** Evicted because the capacity (count or total weight) is exceeded */
+    evicted,
+    /** Removed because its time to live is over */
+    expired,
+};
+
+/**
+ * @brief The statistics of a lru_cache.
+ *
+ */
+struct lru_cache_stats
+{
+    /** The number of lookups which found a live element */
+    uint64_t hits = 0;
+    /** The number of lookups which found nothing or an expired element */
+    uint64_t misses = 0;
+    /** The number of elements evicted because of the capacity */
+    uint64_t evictions = 0;
+    /** The number of elements removed because they expired */
+    uint64_t expirations = 0;
+    /** The number of values loaded successfully by get_or_load() */
+    uint64_t load_successes = 0;
+    /** The number of loaders of get_or_load() which threw an exception */
+    uint64_t load_failures = 0;
+    /** The total time spent in the loaders of get_or_load() */
+    std::chrono::nanoseconds total_load_time{ 0 };
+
+    /**
+     * @brief Get the hit rate of the lookups.
+     *
+     * @return double the hit rate in [0, 1], 0 if there is no lookup.
+     */
+    double hit_rate() const
+    {
+        uint64_t total = hits + misses;
+        return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+    }
+};
+
 /**
  * @brief A template class container for the LRU cache algorithm that can be adapted to various
  * data types, and all operations are thread - safe.
+ * The lookup functions accept any key type which can be compared with K. If both Hash and KeyEqual
+ * are transparent (define is_transparent) and the standard library supports the heterogeneous
+ * lookup of unordered_map (C++20), the key is not converted to K, otherwise a temporary K is
+ * constructed.
+ * The capacity is the number of elements by default, or the total weight (e.g. bytes) of the
+ * elements if a weigher is given. The elements can have a time to live: an expired element is
+ * removed when it is looked up, when it reaches the tail of the list on put(), or by
+ * purge_expired(), which can be called periodically (e.g. by set_interval()) for background expiry.
  *
  * @tparam K The Type of Key
  * @tparam V The Type of Value
+ * @tparam Hash The hash function of the key
+ * @tparam KeyEqual The equality comparison of the key
  */
-template<typename K, typename V>
+template<typename K,
+         typename V,
+         typename Hash = std::hash<K>,
+         typename KeyEqual = std::equal_to<K>>
 class lru_cache
 {
 private:
     // lru_node以 private的方式定义在LRUCache类的内部，防止被外部直接调用
+    // 节点由shared_ptr管理，get_ptr()返回的指针与节点共享所有权，元素被淘汰后仍然有效
     struct lru_node
     {
-        lru_node(K k, V val)
+        template<typename... Args>
+        lru_node(Args&&... args)
+          : prev(nullptr)
+          , next(nullptr)
+          , key(nullptr)
+          , value(std::forward<Args>(args)...)
+          , weight(1)
+          , expire_at(lru_clock::time_point::max())
         {
-            prev = nullptr;
-            next = nullptr;
-            key = k;
-            value = val;
         }
 
         lru_node* prev;
         lru_node* next;
-        K key;
+        // 指向map_中的key，key只保存一份
+        const K* key;
         V value;
+        uint64_t weight;
+        // 过期时间，max()表示永不过期
+        std::chrono::steady_clock::time_point expire_at;
+    };
+
+    using lru_clock = std::chrono::steady_clock;
+    using node_ptr = std::shared_ptr<lru_node>;
+    using map_type = std::unordered_map<K, node_ptr, Hash, KeyEqual>;
+
+    template<typename T, typename = void>
+    struct is_transparent : std::false_type
+    {
+    };
+
+    template<typename T>
+    struct is_transparent<T, typename std::conditional<true, void, typename T::is_transparent>::type>
+      : std::true_type
+    {
     };
 
+    // 是否可以直接使用Q类型的key查找，不构造临时的K
+    template<typename Q>
+    using direct_lookup = std::integral_constant<bool,
+                                                 std::is_same<Q, K>::value
+#if defined(__cpp_lib_generic_unordered_lookup)
+                                                   || (is_transparent<Hash>::value &&
+                                                       is_transparent<KeyEqual>::value)
+#endif
+                                                 >;
+
 public:
+    /**
+     * @brief Function type to get the weight (e.g. the size in bytes) of an element
+     *
+     */
+    using weigher_func = std::function<uint64_t(const K& key, const V& value)>;
+
+    /**
+     * @brief Callback function type of the removal listener
+     *
+     */
+    using removal_listener_func =
+      std::function<void(const K& key, const V& value, lru_removal_cause cause)>;
+
     /**
      * @brief Construct a new lru_cache object
      *
      * @param capacity The maximum capacity of the cache
      */
     lru_cache(int capacity)
-      : capacity_(capacity)
+      : head_(nullptr)
+      , tail_(nullptr)
+      , capacity_(capacity)
       , count_(0)
+      , weight_(0)
+      , default_ttl_(0)
     {
         // std::cout << "lru_cache() called" << std::endl;
     }
 
+    /**
+     * @brief Construct a new lru_cache object whose capacity is the total weight of the elements.
+     *
+     * @param capacity The maximum total weight of the elements
+     * @param weigher The function to get the weight of an element when it is put, an element
+     * heavier than the capacity is evicted at once.
+     */
+    lru_cache(uint64_t capacity, const weigher_func& weigher)
+      : head_(nullptr)
+      , tail_(nullptr)
+      , capacity_(capacity)
+      , count_(0)
+      , weight_(0)
+      , weigher_(weigher)
+      , default_ttl_(0)
+    {
+    }
+
     /**
      * @brief Destroy the lru cache object
      *
@@ -81,35 +236,114 @@ public:
      * @return true
      * @return false
      */
-    bool exist(K key) const
+    template<typename Q = K>
+    bool exist(const Q& key) const
     {
         std::lock_guard<std::mutex> lock(mutex_);
-        return map_.count(key);
+        auto itr = find(key);
+        return itr != map_.end() && !is_expired(itr->second.get(), nullptr);
     }
 
     /**
      * @brief Get the value of the key, if the key does not exist, return a default value.
      * Time complexity: O(1)
+     * @note The value is copied, use try_get() or get_ptr() to avoid copying large values.
      * @param key The key to get the value of
      * @return V The value of the key, or a default value if the key does not exist.
      */
-    V get(K key)
+    template<typename Q = K>
+    V get(const Q& key)
     {
+        removal_batch removed;
         std::lock_guard<std::mutex> lock(mutex_);
+        node_ptr* node = lookup(key, removed);
         // key不存在
-        if (!map_.count(key))
+        if (!node)
         {
-            // TODO
-            // throw std::out_of_range("key not found");
             return V();
         }
+        return (*node)->value;
+    }
 
-        // key存在
-        auto node = map_[key];
-        // 移动到队头，get相当于(最近)使用了该元素
-        move_to_head(node);
+    /**
+     * @brief Get the value of the key by assigning it to out, which can reuse the memory of out.
+     * Time complexity: O(1)
+     * @param key The key to get the value of
+     * @param out The value of the key, unchanged if the key does not exist
+     * @return true if the key exists
+     */
+    template<typename Q = K>
+    bool try_get(const Q& key, V& out)
+    {
+        removal_batch removed;
+        std::lock_guard<std::mutex> lock(mutex_);
+        node_ptr* node = lookup(key, removed);
+        if (!node)
+        {
+            return false;
+        }
+        out = (*node)->value;
+        return true;
+    }
 
-        return node->value;
+    /**
+     * @brief Get a shared pointer to the value of the key without copying it.
+     * The pointer keeps the value alive after it is evicted or removed from the cache, and the
+     * value it points to is never modified: put() replaces the element instead of assigning it
+     * while a pointer is held.
+     * Time complexity: O(1)
+     * @param key The key to get the value of
+     * @return std::shared_ptr<const V> The value of the key, or nullptr if the key does not exist.
+     */
+    template<typename Q = K>
+    std::shared_ptr<const V> get_ptr(const Q& key)
+    {
+        removal_batch removed;
+        std::lock_guard<std::mutex> lock(mutex_);
+        node_ptr* node = lookup(key, removed);
+        if (!node)
+        {
+            return nullptr;
+        }
+        // 与节点共享所有权，指向节点中的value
+        return std::shared_ptr<const V>(*node, &(*node)->value);
+    }
+
+    /**
+     * @brief Get the value of the key, or load it by loader and put it into the cache if the key
+     * does not exist. The loader runs without holding the lock, so concurrent misses of the same
+     * key may load it more than once. The time spent in the loader is recorded in the stats.
+     *
+     * @param key The key to get the value of
+     * @param loader The function V(const K&) to load the value, its exception is rethrown
+     * @return V The value of the key
+     */
+    template<typename Loader>
+    V get_or_load(const K& key, Loader&& loader)
+    {
+        {
+            removal_batch removed;
+            std::lock_guard<std::mutex> lock(mutex_);
+            node_ptr* node = lookup(key, removed);
+            if (node)
+            {
+                return (*node)->value;
+            }
+        }
+
+        auto start = lru_clock::now();
+        try
+        {
+            V value = loader(key);
+            record_load(true, lru_clock::now() - start);
+            put(key, value);
+            return value;
+        }
+        catch (...)
+        {
+            record_load(false, lru_clock::now() - start);
+            throw;
+        }
     }
 
     /**
@@ -118,25 +352,164 @@ public:
      * @param key The key to put the value of
      * @param value The value to put into the cache
      */
-    void put(K key, V value)
+    void put(const K& key, const V& value) { put_value(key, value, nullptr); }
+
+    /**
+     * @brief Put the key-value pair into the cache by moving them. If the key already exists,
+     * update the value.
+     * Time complexity: O(1)
+     * @param key The key to put the value of
+     * @param value The value to put into the cache
+     */
+    void put(K&& key, V&& value) { put_value(std::move(key), std::move(value), nullptr); }
+
+    /**
+     * @brief Put the key-value pair into the cache with a time to live. If the key already exists,
+     * update the value and the time to live.
+     * Time complexity: O(1)
+     * @param key The key to put the value of
+     * @param value The value to put into the cache
+     * @param ttl The time to live of the element, zero means never expire.
+     */
+    void put(const K& key, const V& value, std::chrono::nanoseconds ttl)
+    {
+        put_value(key, value, &ttl);
+    }
+
+    /**
+     * @brief Put the key-value pair into the cache by moving them, with a time to live. If the key
+     * already exists, update the value and the time to live.
+     * Time complexity: O(1)
+     * @param key The key to put the value of
+     * @param value The value to put into the cache
+     * @param ttl The time to live of the element, zero means never expire.
+     */
+    void put(K&& key, V&& value, std::chrono::nanoseconds ttl)
+    {
+        put_value(std::move(key), std::move(value), &ttl);
+    }
+
+    /**
+     * @brief Construct the value in place with args if the key does not exist. If the key already
+     * exists, nothing is changed and args are not used.
+     * Time complexity: O(1)
+     * @param key The key to put the value of
+     * @param args The arguments to construct the value
+     * @return true if the value is inserted, false if the key already exists.
+     */
+    template<typename... Args>
+    bool emplace(K key, Args&&... args)
     {
+        removal_batch removed;
         std::lock_guard<std::mutex> lock(mutex_);
-        if (map_.count(key))
+        auto itr = find(key);
+        if (itr != map_.end())
         {
-            // key在队列中已经存在
-            auto node = map_[key];
-            node->value = value;
-            // 移动对对头，put相当于(最近)使用了该元素
-            move_to_head(node);
+            if (!is_expired(itr->second.get(), nullptr))
+            {
+                return false;
+            }
+            remove_node(itr->second.get(), lru_removal_cause::expired, removed);
         }
-        else
+        node_ptr node = std::make_shared<lru_node>(std::forward<Args>(args)...);
+        set_expire_time(node.get(), default_ttl_);
+        insert(std::move(key), std::move(node), removed);
+        return true;
+    }
+
+    /**
+     * @brief Remove all the expired elements, the removal listener is called for them.
+     * @note This is a time - consuming operation which traverses all elements, call it
+     * periodically (e.g. by set_interval()) to expire the elements which are never looked up.
+     *
+     * @return size_t The number of the removed elements
+     */
+    size_t purge_expired()
+    {
+        removal_batch removed;
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = lru_clock::now();
+        size_t count = 0;
+        lru_node* itr = head_;
+        while (itr)
         {
-            // key在队列中不存在
-            lru_node* node = new lru_node(key, value);
-            // 添加到队列
-            push_to_queue(node);
-            map_[key] = node;
+            lru_node* node = itr;
+            itr = itr->next;
+            if (is_expired(node, &now))
+            {
+                remove_node(node, lru_removal_cause::expired, removed);
+                count++;
+            }
         }
+        return count;
+    }
+
+    /**
+     * @brief Set the time to live of the elements put without one.
+     *
+     * @param ttl The time to live, zero (the default) means never expire.
+     */
+    void set_default_ttl(std::chrono::nanoseconds ttl)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        default_ttl_ = ttl;
+    }
+
+    /**
+     * @brief Set the listener called when an element is evicted or expired.
+     * @note The listener is called after the lock of the cache is released, in the thread which
+     * removed the element, so it can access the cache. It must not throw exceptions. clear() does
+     * not call it.
+     *
+     * @param listener The listener, nullptr to remove it
+     */
+    void set_removal_listener(const removal_listener_func& listener)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        listener_ = listener ? std::make_shared<removal_listener_func>(listener) : nullptr;
+    }
+
+    /**
+     * @brief Get the statistics of the cache.
+     *
+     * @return lru_cache_stats
+     */
+    lru_cache_stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return stats_;
+    }
+
+    /**
+     * @brief Reset the statistics to zero.
+     *
+     */
+    void reset_stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_ = lru_cache_stats();
+    }
+
+    /**
+     * @brief Get the number of elements in the cache, including the expired ones not removed yet.
+     *
+     * @return uint64_t
+     */
+    uint64_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+    /**
+     * @brief Get the total weight of the elements, the same as size() if there is no weigher.
+     *
+     * @return uint64_t
+     */
+    uint64_t weight() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return weight_;
     }
 
     /**
@@ -147,17 +520,12 @@ public:
     {
         // std::cout << "start ~lru_cache() count:" << count_ << std::endl;
         std::lock_guard<std::mutex> lock(mutex_);
+        // 节点的内存由map_中的shared_ptr管理
         map_.clear();
-        lru_node* itr = head_;
-        while (itr)
-        {
-            lru_node* tmp = itr;
-            itr = itr->next;
-            delete tmp;
-        }
         head_ = nullptr;
         tail_ = nullptr;
         count_ = 0;
+        weight_ = 0;
         // std::cout << "~lru_cache() called, count:" << count_ << std::endl;
     }
 
@@ -177,127 +545,995 @@ public:
         lru_node* itr = head_;
         while (itr)
         {
-            callback(itr->key, itr->value);
+            callback(*itr->key, itr->value);
             itr = itr->next;
         }
     }
 
 private:
-    void push_to_queue(lru_node* node)
+    // 一次操作中被移除的元素，在释放锁之后(析构时)调用监听者
+    struct removal
     {
-        if (count_ == 0)
-        { // 空队列
-            head_ = node;
-            tail_ = node;
-            count_++;
-        }
-        else
-        { // 插入对头
-            head_->prev = node;
-            node->next = head_;
-            head_ = node;
-            head_->prev = nullptr;
-            count_++;
+        K key;
+        node_ptr node;
+        lru_removal_cause cause;
+    };
+
+    class removal_batch
+    {
+    public:
+        removal_batch() = default;
+        removal_batch(const removal_batch&) = delete;
+        removal_batch& operator=(const removal_batch&) = delete;
 
-            // 超出队列的最大容量，删除队尾元素
-            if (count_ > capacity_)
+        ~removal_batch()
+        {
+            for (const auto& item : items)
             {
-                pop_from_queue();
+                (*listener)(item.key, item.node->value, item.cause);
             }
         }
+
+        std::shared_ptr<removal_listener_func> listener;
+        std::vector<removal> items;
+    };
+
+    template<typename Q>
+    typename map_type::const_iterator find(const Q& key) const
+    {
+        return find(key, direct_lookup<Q>());
     }
-    void pop_from_queue()
+
+    template<typename Q>
+    typename map_type::iterator find(const Q& key)
     {
-        // 空队列，不做任何处理
-        if (count_ == 0)
-        {
-            return;
-        }
+        return find(key, direct_lookup<Q>());
+    }
 
-        auto key = tail_->key;
-        lru_node* tmp = tail_;
-        if (count_ == 1)
-        { // 只有一个元素，清空队列
-            head_ = nullptr;
-            tail_ = nullptr;
-        }
-        else
-        { // 出队列：移除队尾元素
-            tail_ = tail_->prev;
-            tail_->next = nullptr;
-        }
-        // 删除节点和map_的映射
-        map_.erase(key);
-        delete tmp;
-        count_--;
+    template<typename Q>
+    typename map_type::const_iterator find(const Q& key, std::true_type) const
+    {
+        return map_.find(key);
     }
 
-    void remove_from_queue(lru_node* node)
+    template<typename Q>
+    typename map_type::iterator find(const Q& key, std::true_type)
+    {
+        return map_.find(key);
+    }
+
+    template<typename Q>
+    typename map_type::const_iterator find(const Q& key, std::false_type) const
+    {
+        return map_.find(K(key));
+    }
+
+    template<typename Q>
+    typename map_type::iterator find(const Q& key, std::false_type)
+    {
+        return map_.find(K(key));
+    }
+
+    // 查找key(只计算一次哈希)，存在时移动到队头，get相当于(最近)使用了该元素
+    // 已过期的元素在查找时移除，视为不存在
+    template<typename Q>
+    node_ptr* lookup(const Q& key, removal_batch& removed)
     {
-        // 只有一个元素
-        if (node->prev == nullptr && node->next == nullptr)
+        auto itr = find(key);
+        if (itr == map_.end())
         {
-            head_ = nullptr;
-            tail_ = nullptr;
+            stats_.misses++;
+            return nullptr;
         }
-        else if (node->prev == nullptr && node->next != nullptr)
+        lru_node* node = itr->second.get();
+        if (is_expired(node, nullptr))
         {
-            // 队头元素
-            head_ = node->next;
-            node->next->prev = nullptr;
+            stats_.misses++;
+            remove_node(node, lru_removal_cause::expired, removed);
+            return nullptr;
         }
-        else if (node->prev != nullptr && node->next == nullptr)
+        stats_.hits++;
+        move_to_head(node);
+        return &itr->second;
+    }
+
+    // now为空时按需获取当前时间，永不过期的元素不需要获取时间
+    static bool is_expired(const lru_node* node, const lru_clock::time_point* now)
+    {
+        if (node->expire_at == lru_clock::time_point::max())
         {
-            // 队尾元素
-            tail_ = node->prev;
-            node->prev->next = nullptr;
+            return false;
+        }
+        return node->expire_at <= (now ? *now : lru_clock::now());
+    }
+
+    static void set_expire_time(lru_node* node, std::chrono::nanoseconds ttl)
+    {
+        node->expire_at = ttl > std::chrono::nanoseconds::zero()
+                            ? lru_clock::now() + std::chrono::duration_cast<lru_clock::duration>(ttl)
+                            : lru_clock::time_point::max();
+    }
+
+    void record_load(bool success, lru_clock::duration cost)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (success)
+        {
+            stats_.load_successes++;
         }
-        else if (node->prev != nullptr && node->next != nullptr)
+        else
         {
-            // 队中元素
-            node->prev->next = node->next;
-            node->next->prev = node->prev;
+            stats_.load_failures++;
         }
-        map_.erase(node->key);
-        delete node;
+        stats_.total_load_time += std::chrono::duration_cast<std::chrono::nanoseconds>(cost);
     }
 
-    void move_to_head(lru_node* node)
+    // ttl为空时使用默认的过期时间
+    template<typename KK, typename VV>
+    void put_value(KK&& key, VV&& value, const std::chrono::nanoseconds* ttl)
     {
-        // node本身就是对头节点，不做任何操作
-        if (node == head_)
+        removal_batch removed;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ttl)
+        {
+            ttl = &default_ttl_;
+        }
+        auto itr = find(key);
+        if (itr == map_.end())
         {
+            // key在队列中不存在
+            node_ptr node = std::make_shared<lru_node>(std::forward<VV>(value));
+            set_expire_time(node.get(), *ttl);
+            insert(std::forward<KK>(key), std::move(node), removed);
             return;
         }
 
-        // 移除元素
-        if (node->prev != nullptr && node->next == nullptr)
+        // key在队列中已经存在
+        node_ptr& node = itr->second;
+        weight_ -= node->weight;
+        if (node.use_count() == 1)
         {
-            // 队尾元素
-            tail_ = node->prev;
-            tail_->next = nullptr;
+            // 没有get_ptr()返回的指针引用该节点，直接修改
+            // use_count()是relaxed读取，需要与其它线程释放指针时的写入同步
+            std::atomic_thread_fence(std::memory_order_acquire);
+            node->value = std::forward<VV>(value);
+            move_to_head(node.get());
         }
-        else if (node->prev != nullptr && node->next != nullptr)
+        else
         {
-            // 队中元素
-            node->prev->next = node->next;
-            node->next->prev = node->prev;
+            // 节点被外部引用，不能修改其中的value，使用新节点替换
+            node_ptr replacement = std::make_shared<lru_node>(std::forward<VV>(value));
+            replacement->key = node->key;
+            remove_from_queue(node.get());
+            push_to_queue(replacement.get());
+            node = std::move(replacement);
         }
+        set_expire_time(node.get(), *ttl);
+        node->weight = weigh(node.get());
+        weight_ += node->weight;
+        shrink(node.get(), removed);
+    }
 
-        // 插入到对头
-        head_->prev = node;
-        node->next = head_;
-        head_ = node;
-        head_->prev = nullptr;
+    // 调用前需确认key不存在
+    void insert(K&& key, node_ptr node, removal_batch& removed)
+    {
+        lru_node* raw = node.get();
+        auto result = map_.emplace(std::move(key), std::move(node));
+        raw->key = &result.first->first;
+        raw->weight = weigh(raw);
+        weight_ += raw->weight;
+        // 添加到队列
+        push_to_queue(raw);
+        shrink(raw, removed);
     }
 
-private:
-    std::mutex mutex_;
-    lru_node* head_;
-    lru_node* tail_;
-    uint64_t capacity_;
-    uint64_t count_;
-    std::unordered_map<K, lru_node*> map_;
-};
+    void insert(const K& key, node_ptr node, removal_batch& removed)
+    {
+        insert(K(key), std::move(node), removed);
+    }
+
+    uint64_t weigh(const lru_node* node) const
+    {
+        return weigher_ ? weigher_(*node->key, node->value) : 1;
+    }
+
+    // 移除队尾已过期的元素(最多几个，不长时间持有锁)，超出容量时再淘汰队尾元素
+    // 刚放入的元素比容量还大时直接淘汰它，不淘汰其它元素
+    void shrink(lru_node* newest, removal_batch& removed)
+    {
+        if (newest->weight > capacity_)
+        {
+            remove_node(newest, lru_removal_cause::evicted, removed);
+        }
+
+        if (tail_ && tail_->expire_at != lru_clock::time_point::max())
+        {
+            auto now = lru_clock::now();
+            for (int i = 0; i < 4 && tail_ && is_expired(tail_, &now); i++)
+            {
+                remove_node(tail_, lru_removal_cause::expired, removed);
+            }
+        }
+
+        // 超出队列的最大容量，删除队尾元素
+        while (weight_ > capacity_ && tail_)
+        {
+            remove_node(tail_, lru_removal_cause::evicted, removed);
+        }
+    }
+
+    // 从队列和map_中移除节点，需要通知时把节点交给removed，否则释放节点
+    void remove_node(lru_node* node, lru_removal_cause cause, removal_batch& removed)
+    {
+        if (cause == lru_removal_cause::evicted)
+        {
+            stats_.evictions++;
+        }
+        else
+        {
+            stats_.expirations++;
+        }
+
+        remove_from_queue(node);
+        weight_ -= node->weight;
+        auto itr = map_.find(*node->key);
+        if (listener_)
+        {
+            removed.listener = listener_;
+            removed.items.push_back(removal{ itr->first, itr->second, cause });
+        }
+        map_.erase(itr);
+    }
+
+    // 插入到队头
+    void push_to_queue(lru_node* node)
+    {
+        node->prev = nullptr;
+        node->next = head_;
+        if (head_)
+        {
+            head_->prev = node;
+        }
+        head_ = node;
+        if (!tail_)
+        {
+            tail_ = node;
+        }
+        count_++;
+    }
+
+    // 从队列中移除节点，不释放节点
+    void remove_from_queue(lru_node* node)
+    {
+        if (node->prev)
+        {
+            node->prev->next = node->next;
+        }
+        else
+        {
+            // 队头元素
+            head_ = node->next;
+        }
+        if (node->next)
+        {
+            node->next->prev = node->prev;
+        }
+        else
+        {
+            // 队尾元素
+            tail_ = node->prev;
+        }
+        node->prev = nullptr;
+        node->next = nullptr;
+        count_--;
+    }
+
+    void move_to_head(lru_node* node)
+    {
+        // node本身就是对头节点，不做任何操作
+        if (node == head_)
+        {
+            return;
+        }
+
+        remove_from_queue(node);
+        push_to_queue(node);
+    }
+
+private:
+    mutable std::mutex mutex_;
+    lru_node* head_;
+    lru_node* tail_;
+    uint64_t capacity_;
+    uint64_t count_;
+    uint64_t weight_;
+    map_type map_;
+    weigher_func weigher_;
+    std::chrono::nanoseconds default_ttl_;
+    std::shared_ptr<removal_listener_func> listener_;
+    lru_cache_stats stats_;
+};
+
+/**
+ * @brief How a sharded_lru_cache records the recency of the elements on cache hits.
+ *
+ */
+enum class lru_recency
+{
+    /** Move the element to the head of the list on every hit, the exact LRU order */
+    exact,
+    /**
+     * Only mark the element as referenced on a hit, the list is not modified. The referenced
+     * elements at the tail get a second chance (moved to the head in a batch) when evicting, which
+     * approximates LRU (the CLOCK algorithm) and keeps the critical section of get() short.
+     */
+    lazy,
+};
+
+/**
+ * @brief A thread-safe LRU cache partitioned into several independently locked shards by the hash
+ * of the keys, so that the threads accessing different shards do not contend on one mutex.
+ * Each shard is an LRU list with capacity / shard_count elements, so the eviction order is LRU
+ * within a shard and approximately LRU for the whole cache.
+ *
+ * @tparam K The Type of Key
+ * @tparam V The Type of Value
+ * @tparam Hash The hash function of the key
+ */
+template<typename K, typename V, typename Hash = std::hash<K>>
+class sharded_lru_cache
+{
+private:
+    struct lru_node
+    {
+        lru_node(const K& k, const V& val)
+          : prev(nullptr)
+          , next(nullptr)
+          , key(k)
+          , value(val)
+          , referenced(false)
+        {
+        }
+
+        lru_node* prev;
+        lru_node* next;
+        K key;
+        V value;
+        // lazy模式: 命中后被标记，淘汰时获得一次重新放回队头的机会
+        bool referenced;
+    };
+
+    struct shard
+    {
+        shard()
+          : head(nullptr)
+          , tail(nullptr)
+          , count(0)
+        {
+        }
+
+        std::mutex mutex;
+        lru_node* head;
+        lru_node* tail;
+        uint64_t count;
+        std::unordered_map<K, lru_node*, Hash> map;
+        // 相邻分片的锁不在同一个缓存行，避免伪共享
+        char padding[64];
+    };
+
+public:
+    /**
+     * @brief Callback function type for for_each()
+     *
+     */
+    using visit_lru_node_func = std::function<void(const K& key, const V& value)>;
+
+    /**
+     * @brief Construct a new sharded_lru_cache object
+     *
+     * @param capacity The maximum capacity of the cache, split evenly into the shards
+     * @param shard_count The number of shards, rounded up to a power of two. 0 means four times the
+     * number of hardware threads (but no more shards than capacity).
+     * @param recency How to record the recency on cache hits
+     */
+    sharded_lru_cache(uint64_t capacity,
+                      uint32_t shard_count = 0,
+                      lru_recency recency = lru_recency::exact)
+      : recency_(recency)
+      , shard_bits_(0)
+    {
+        if (shard_count == 0)
+        {
+            shard_count = std::max(std::thread::hardware_concurrency(), 1U) * 4;
+            shard_count = static_cast<uint32_t>(
+              std::min<uint64_t>(shard_count, std::max<uint64_t>(capacity, 1)));
+        }
+        while ((1U << shard_bits_) < shard_count)
+        {
+            shard_bits_++;
+        }
+        shard_count_ = 1U << shard_bits_;
+        shard_capacity_ = std::max<uint64_t>((capacity + shard_count_ - 1) / shard_count_, 1);
+        shards_.reset(new shard[shard_count_]);
+    }
+
+    /**
+     * @brief Destroy the sharded lru cache object
+     *
+     */
+    ~sharded_lru_cache() { clear(); }
+
+    // 不可以复制
+    sharded_lru_cache(const sharded_lru_cache&) = delete;
+    sharded_lru_cache& operator=(const sharded_lru_cache&) = delete;
+
+    /**
+     * @brief Whether the cache contains the key
+     *
+     * @param key
+     * @return true
+     * @return false
+     */
+    bool exist(const K& key) const
+    {
+        shard& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return s.map.count(key) > 0;
+    }
+
+    /**
+     * @brief Get the value of the key, if the key does not exist, return a default value.
+     * Time complexity: O(1)
+     * @param key The key to get the value of
+     * @return V The value of the key, or a default value if the key does not exist.
+     */
+    V get(const K& key)
+    {
+        shard& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto itr = s.map.find(key);
+        if (itr == s.map.end())
+        {
+            return V();
+        }
+
+        lru_node* node = itr->second;
+        touch(s, node);
+        return node->value;
+    }
+
+    /**
+     * @brief Put the key-value pair into the cache. If the key already exists, update the value.
+     * Time complexity: O(1)
+     * @param key The key to put the value of
+     * @param value The value to put into the cache
+     */
+    void put(const K& key, const V& value)
+    {
+        shard& s = shard_of(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto itr = s.map.find(key);
+        if (itr != s.map.end())
+        {
+            lru_node* node = itr->second;
+            node->value = value;
+            touch(s, node);
+            return;
+        }
+
+        // 先淘汰再插入: lazy模式下被标记的元素会被移到队头，新节点若已在队头会成为队尾被淘汰
+        if (s.count >= shard_capacity_)
+        {
+            evict(s);
+        }
+        lru_node* node = new lru_node(key, value);
+        push_front(s, node);
+        s.map.emplace(key, node);
+        s.count++;
+    }
+
+    /**
+     * @brief Clean the cache, remove all elements.
+     *
+     */
+    void clear()
+    {
+        for (uint32_t i = 0; i < shard_count_; i++)
+        {
+            shard& s = shards_[i];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.map.clear();
+            lru_node* itr = s.head;
+            while (itr)
+            {
+                lru_node* tmp = itr;
+                itr = itr->next;
+                delete tmp;
+            }
+            s.head = nullptr;
+            s.tail = nullptr;
+            s.count = 0;
+        }
+    }
+
+    /**
+     * @brief Traverse all elements in the cache, shard by shard, from the most recently used to the
+     * least recently used in each shard.
+     * @note This is a time - consuming operation, and each shard is locked while it is traversed.
+     * @param callback The callback function to be called for each element in the cache.
+     */
+    void for_each(visit_lru_node_func callback)
+    {
+        for (uint32_t i = 0; i < shard_count_; i++)
+        {
+            shard& s = shards_[i];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            for (lru_node* itr = s.head; itr; itr = itr->next)
+            {
+                callback(itr->key, itr->value);
+            }
+        }
+    }
+
+    /**
+     * @brief Get the number of elements in the cache.
+     * @note The shards are counted one by one, the result is approximate when other threads are
+     * modifying the cache.
+     *
+     * @return uint64_t
+     */
+    uint64_t size() const
+    {
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < shard_count_; i++)
+        {
+            std::lock_guard<std::mutex> lock(shards_[i].mutex);
+            total += shards_[i].count;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Get the maximum capacity of the cache (the capacity of all shards).
+     *
+     * @return uint64_t
+     */
+    uint64_t capacity() const { return shard_capacity_ * shard_count_; }
+
+    /**
+     * @brief Get the number of shards.
+     *
+     * @return uint32_t
+     */
+    uint32_t shard_count() const { return shard_count_; }
+
+private:
+    shard& shard_of(const K& key) const
+    {
+        // 分片内的unordered_map使用哈希值的低位，分片使用打散后的高位，避免两者相关
+        uint64_t mixed = static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL;
+        return shards_[shard_bits_ == 0 ? 0 : static_cast<uint32_t>(mixed >> (64 - shard_bits_))];
+    }
+
+    // 命中时更新最近使用的顺序
+    void touch(shard& s, lru_node* node)
+    {
+        if (recency_ == lru_recency::lazy)
+        {
+            // 只在未标记时写入，避免热点数据的重复写
+            if (!node->referenced)
+            {
+                node->referenced = true;
+            }
+            return;
+        }
+        if (node != s.head)
+        {
+            unlink(s, node);
+            push_front(s, node);
+        }
+    }
+
+    void push_front(shard& s, lru_node* node)
+    {
+        node->prev = nullptr;
+        node->next = s.head;
+        if (s.head)
+        {
+            s.head->prev = node;
+        }
+        s.head = node;
+        if (!s.tail)
+        {
+            s.tail = node;
+        }
+    }
+
+    void unlink(shard& s, lru_node* node)
+    {
+        if (node->prev)
+        {
+            node->prev->next = node->next;
+        }
+        else
+        {
+            s.head = node->next;
+        }
+        if (node->next)
+        {
+            node->next->prev = node->prev;
+        }
+        else
+        {
+            s.tail = node->prev;
+        }
+        node->prev = nullptr;
+        node->next = nullptr;
+    }
+
+    // 淘汰队尾元素；lazy模式下被标记过的元素清除标记后放回队头(最多循环count次)
+    void evict(shard& s)
+    {
+        lru_node* victim = s.tail;
+        for (uint64_t i = 0; i < s.count && victim->referenced; i++)
+        {
+            victim->referenced = false;
+            unlink(s, victim);
+            push_front(s, victim);
+            victim = s.tail;
+        }
+
+        unlink(s, victim);
+        s.map.erase(victim->key);
+        delete victim;
+        s.count--;
+    }
+
+private:
+    lru_recency recency_;
+    uint32_t shard_bits_;
+    uint32_t shard_count_;
+    uint64_t shard_capacity_;
+    std::unique_ptr<shard[]> shards_;
+};
+
+/**
+ * @brief A thread-safe LRU cache whose storage is preallocated, for caches with heavy churn.
+ * All the capacity nodes live in one contiguous slab and are linked by indexes instead of pointers,
+ * the keys are indexed by an open-addressing hash table (linear probing) which stores only the
+ * node indexes, so every key is stored once. Once constructed, put() and the eviction do not
+ * allocate memory (except what the assignment of K or V itself allocates): an evicted node is
+ * reused in place for the new element.
+ * @note K and V must be default constructible and copy assignable.
+ *
+ * @tparam K The Type of Key
+ * @tparam V The Type of Value
+ * @tparam Hash The hash function of the key
+ * @tparam KeyEqual The equality comparison of the key
+ */
+template<typename K,
+         typename V,
+         typename Hash = std::hash<K>,
+         typename KeyEqual = std::equal_to<K>>
+class slab_lru_cache
+{
+private:
+    // 节点之间使用下标链接，npos表示空
+    static constexpr uint32_t npos = ~static_cast<uint32_t>(0);
+
+    struct slab_node
+    {
+        K key;
+        V value;
+        // 打散后的哈希值，用于比较和计算在索引表中的位置
+        uint64_t hash;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+public:
+    /**
+     * @brief Callback function type for for_each()
+     *
+     */
+    using visit_lru_node_func = std::function<void(const K& key, const V& value)>;
+
+    /**
+     * @brief Construct a new slab_lru_cache object, preallocate all the nodes and the hash index.
+     *
+     * @param capacity The maximum capacity of the cache (at least 1)
+     */
+    slab_lru_cache(uint32_t capacity)
+      : capacity_(std::max<uint32_t>(std::min<uint32_t>(capacity, npos / 2), 1))
+      , count_(0)
+      , head_(npos)
+      , tail_(npos)
+      , free_(npos)
+      , index_shift_(64)
+      , nodes_(capacity_)
+    {
+        // 索引表的大小是不小于2倍容量的2的幂，负载因子不超过0.5，探测长度短
+        uint64_t index_size = 1;
+        while (index_size < static_cast<uint64_t>(capacity_) * 2)
+        {
+            index_size <<= 1;
+            index_shift_--;
+        }
+        index_.assign(index_size, npos);
+        reset_free_list();
+    }
+
+    /**
+     * @brief Destroy the slab lru cache object
+     *
+     */
+    ~slab_lru_cache() = default;
+
+    // 不可以复制
+    slab_lru_cache(const slab_lru_cache&) = delete;
+    slab_lru_cache& operator=(const slab_lru_cache&) = delete;
+
+    /**
+     * @brief Whether the cache contains the key
+     *
+     * @param key
+     * @return true
+     * @return false
+     */
+    bool exist(const K& key) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return find_slot(key, mix_hash(key)) != npos;
+    }
+
+    /**
+     * @brief Get the value of the key, if the key does not exist, return a default value.
+     * Time complexity: O(1)
+     * @param key The key to get the value of
+     * @return V The value of the key, or a default value if the key does not exist.
+     */
+    V get(const K& key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t slot = find_slot(key, mix_hash(key));
+        if (slot == npos)
+        {
+            return V();
+        }
+
+        uint32_t idx = index_[slot];
+        move_to_head(idx);
+        return nodes_[idx].value;
+    }
+
+    /**
+     * @brief Put the key-value pair into the cache. If the key already exists, update the value.
+     * If the cache is full, the least recently used node is reused for the new element.
+     * Time complexity: O(1)
+     * @param key The key to put the value of
+     * @param value The value to put into the cache
+     */
+    void put(const K& key, const V& value)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t hash = mix_hash(key);
+        uint32_t slot = find_slot(key, hash);
+        if (slot != npos)
+        {
+            uint32_t idx = index_[slot];
+            nodes_[idx].value = value;
+            move_to_head(idx);
+            return;
+        }
+
+        uint32_t idx = free_;
+        if (idx != npos)
+        {
+            free_ = nodes_[idx].next;
+            count_++;
+        }
+        else
+        {
+            // 缓存已满，淘汰队尾的节点并就地复用
+            idx = tail_;
+            erase_slot(find_slot(nodes_[idx].key, nodes_[idx].hash));
+            unlink(idx);
+        }
+
+        slab_node& node = nodes_[idx];
+        node.key = key;
+        node.value = value;
+        node.hash = hash;
+        push_front(idx);
+        insert_slot(idx);
+    }
+
+    /**
+     * @brief Clean the cache, remove all elements. The memory is kept for reuse.
+     *
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint32_t i = head_; i != npos; i = nodes_[i].next)
+        {
+            // 释放key和value持有的资源
+            nodes_[i].key = K();
+            nodes_[i].value = V();
+        }
+        std::fill(index_.begin(), index_.end(), npos);
+        head_ = npos;
+        tail_ = npos;
+        count_ = 0;
+        reset_free_list();
+    }
+
+    /**
+     * @brief Traverse all elements in the cache, from the most recently used to the least recently
+     * used.
+     * @note This is a time - consuming operation, and the cache is locked while it is traversed.
+     * @param callback The callback function to be called for each element in the cache.
+     */
+    void for_each(visit_lru_node_func callback)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (uint32_t i = head_; i != npos; i = nodes_[i].next)
+        {
+            callback(nodes_[i].key, nodes_[i].value);
+        }
+    }
+
+    /**
+     * @brief Get the number of elements in the cache.
+     *
+     * @return uint32_t
+     */
+    uint32_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return count_;
+    }
+
+    /**
+     * @brief Get the maximum capacity of the cache.
+     *
+     * @return uint32_t
+     */
+    uint32_t capacity() const { return capacity_; }
+
+private:
+    static uint64_t mix_hash(const K& key)
+    {
+        // 打散哈希值，使用高位定位，避免std::hash对整数是恒等映射时线性探测产生聚集
+        return static_cast<uint64_t>(Hash()(key)) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    uint32_t home_slot(uint64_t hash) const
+    {
+        return index_shift_ >= 64 ? 0 : static_cast<uint32_t>(hash >> index_shift_);
+    }
+
+    // 查找key所在的索引表位置，不存在时返回npos
+    uint32_t find_slot(const K& key, uint64_t hash) const
+    {
+        uint32_t mask = static_cast<uint32_t>(index_.size() - 1);
+        for (uint32_t slot = home_slot(hash);; slot = (slot + 1) & mask)
+        {
+            uint32_t idx = index_[slot];
+            if (idx == npos)
+            {
+                return npos;
+            }
+            if (nodes_[idx].hash == hash && KeyEqual()(nodes_[idx].key, key))
+            {
+                return slot;
+            }
+        }
+    }
+
+    void insert_slot(uint32_t idx)
+    {
+        uint32_t mask = static_cast<uint32_t>(index_.size() - 1);
+        uint32_t slot = home_slot(nodes_[idx].hash);
+        while (index_[slot] != npos)
+        {
+            slot = (slot + 1) & mask;
+        }
+        index_[slot] = idx;
+    }
+
+    // 线性探测的删除: 把后面的元素向前移动填补空位，不使用墓碑标记
+    void erase_slot(uint32_t slot)
+    {
+        uint32_t mask = static_cast<uint32_t>(index_.size() - 1);
+        uint32_t hole = slot;
+        index_[hole] = npos;
+        for (uint32_t cur = (hole + 1) & mask; index_[cur] != npos; cur = (cur + 1) & mask)
+        {
+            uint32_t home = home_slot(nodes_[index_[cur]].hash);
+            // home不在(hole, cur]的环形区间内时，元素可以前移到hole
+            bool stay = hole <= cur ? (hole < home && home <= cur) : (hole < home || home <= cur);
+            if (!stay)
+            {
+                index_[hole] = index_[cur];
+                index_[cur] = npos;
+                hole = cur;
+            }
+        }
+    }
+
+    void reset_free_list()
+    {
+        for (uint32_t i = 0; i < capacity_; i++)
+        {
+            nodes_[i].prev = npos;
+            nodes_[i].next = i + 1 < capacity_ ? i + 1 : npos;
+        }
+        free_ = 0;
+    }
+
+    void push_front(uint32_t idx)
+    {
+        nodes_[idx].prev = npos;
+        nodes_[idx].next = head_;
+        if (head_ != npos)
+        {
+            nodes_[head_].prev = idx;
+        }
+        head_ = idx;
+        if (tail_ == npos)
+        {
+            tail_ = idx;
+        }
+    }
+
+    void unlink(uint32_t idx)
+    {
+        slab_node& node = nodes_[idx];
+        if (node.prev != npos)
+        {
+            nodes_[node.prev].next = node.next;
+        }
+        else
+        {
+            head_ = node.next;
+        }
+        if (node.next != npos)
+        {
+            nodes_[node.next].prev = node.prev;
+        }
+        else
+        {
+            tail_ = node.prev;
+        }
+        node.prev = npos;
+        node.next = npos;
+    }
+
+    void move_to_head(uint32_t idx)
+    {
+        if (idx != head_)
+        {
+            unlink(idx);
+            push_front(idx);
+        }
+    }
+
+private:
+    mutable std::mutex mutex_;
+    uint32_t capacity_;
+    uint32_t count_;
+    uint32_t head_;
+    uint32_t tail_;
+    // 空闲节点链表(通过next链接)
+    uint32_t free_;
+    uint32_t index_shift_;
+    std::vector<slab_node> nodes_;
+    // 开放寻址的哈希索引，保存节点下标
+    std::vector<uint32_t> index_;
+};
+
+template<typename K, typename V, typename Hash, typename KeyEqual>
+constexpr uint32_t slab_lru_cache<K, V, Hash, KeyEqual>::npos;
 
 } // namespace cutl
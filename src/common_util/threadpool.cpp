@@ -1,19 +1,62 @@
 ﻿#include "threadpool.h"
-#include "algoutil.h"
 #include "inner/logger.h"
 #include "threadutil.h"
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 namespace cutl
 {
 
 static constexpr unsigned int MIN_THREAD_NUM = 1;
-static constexpr unsigned int MAX_THREAD_NUM = 16;
 
-threadpool::threadpool(const std::string& name, uint32_t max_task_size)
+// 自旋等待时降低CPU的功耗和对超线程的影响
+static inline void cpu_relax()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
+}
+
+// 当前线程所属的线程池及其在线程池中的序号(work_stealing模式)
+static thread_local const threadpool* tls_current_pool = nullptr;
+static thread_local uint32_t tls_worker_index = 0;
+
+// 防止低优先级任务饿死：工作线程每取NORMAL_FIRST_INTERVAL次任务，有一次从normal队列开始取，
+// 每取LOW_FIRST_INTERVAL次任务，有一次从low队列开始取
+static constexpr uint32_t NORMAL_FIRST_INTERVAL = 4;
+static constexpr uint32_t LOW_FIRST_INTERVAL = 16;
+static thread_local uint32_t tls_pop_round = 0;
+
+threadpool::threadpool(const std::string& name, uint32_t max_task_size, threadpool_mode mode)
   : name_(name)
   , is_running_(false)
   , max_task_size_(max_task_size)
+  , mode_(mode)
+  , pending_tasks_(0)
+  , idle_workers_(0)
+  , blocked_producers_(0)
+  , min_threads_(0)
+  , max_threads_(0)
+  , keep_alive_(0)
+  , elastic_(false)
+  , thread_count_(0)
+  , peak_thread_count_(0)
+  , busy_workers_(0)
+  , stats_enabled_(true)
+  , rejected_tasks_(0)
+  , queue_high_water_(0)
 {
+    for (auto& queue : task_queues_)
+    {
+        queue.reset(new mpmc_queue<queued_task>(max_task_size));
+    }
 }
 
 threadpool::~threadpool()
@@ -23,46 +66,144 @@ threadpool::~threadpool()
         stop();
     }
 
-    if (!threads_.empty())
-    {
-        clear();
-    }
+    clear();
 }
 
 void threadpool::start(uint32_t thread_num)
 {
-    if (is_running_.load())
-    {
-        CUTL_WARN("Threadpool " + name_ + " is already running");
-        return;
-    }
-
     if (thread_num == 0)
     {
         // 获取当前系统支持的并发线程数的估计值
-        thread_num = std::thread::hardware_concurrency();
+        thread_num = std::max(std::thread::hardware_concurrency(), MIN_THREAD_NUM);
         CUTL_INFO("Threadpool " + name_ +
                   " set thread num to hardware_concurrency:" + std::to_string(thread_num));
     }
     else
     {
-        thread_num = cutl::clamp(thread_num, MIN_THREAD_NUM, MAX_THREAD_NUM);
         CUTL_INFO("Threadpool " + name_ + " set thread num to " + std::to_string(thread_num));
     }
 
-    is_running_.store(true);
-    for (uint32_t i = 0; i < thread_num; i++)
+    // 固定大小的线程池
+    threadpool_sizing sizing;
+    sizing.min_threads = thread_num;
+    sizing.max_threads = thread_num;
+    start(sizing);
+}
+
+void threadpool::set_idle_policy(const threadpool_idle_policy& policy)
+{
+    if (is_running_.load())
+    {
+        CUTL_WARN("Threadpool " + name_ + " is running, the idle policy can not be changed");
+        return;
+    }
+    idle_policy_ = policy;
+}
+
+void threadpool::set_stats_enabled(bool enabled)
+{
+    if (is_running_.load())
+    {
+        CUTL_WARN("Threadpool " + name_ + " is running, the stats switch can not be changed");
+        return;
+    }
+    stats_enabled_ = enabled;
+}
+
+void threadpool::set_placement(const thread_placement& placement)
+{
+    if (is_running_.load())
+    {
+        CUTL_WARN("Threadpool " + name_ + " is running, the placement can not be changed");
+        return;
+    }
+    placement_ = placement;
+}
+
+std::vector<std::unique_ptr<threadpool>> threadpool::create_per_numa_node(const std::string& name,
+                                                                          uint32_t threads_per_node,
+                                                                          uint32_t max_task_size,
+                                                                          threadpool_mode mode)
+{
+    std::vector<std::unique_ptr<threadpool>> pools;
+    uint32_t node_count = get_numa_node_count();
+    for (uint32_t node = 0; node < node_count; node++)
     {
-        auto thread = std::thread(
-          [this]()
+        auto cpus = get_numa_node_cpus(node);
+        if (cpus.empty())
+        {
+            // 没有CPU的节点(如只有内存的节点)
+            pools.emplace_back(nullptr);
+            continue;
+        }
+
+        thread_placement placement;
+        placement.mode = thread_placement_mode::compact;
+        placement.numa_node = node;
+        uint32_t threads =
+          threads_per_node > 0 ? threads_per_node : static_cast<uint32_t>(cpus.size());
+
+        // 在绑定到该节点的线程中创建并启动线程池，按照首次访问(first-touch)策略，
+        // 任务队列等内存会分配在该节点本地
+        std::unique_ptr<threadpool> pool;
+        std::thread creator(
+          [&]()
           {
-              while (is_running_.load())
-              {
-                  call_one_task();
-              }
+              apply_thread_placement(placement, 0);
+              pool.reset(new threadpool(name + "_n" + std::to_string(node), max_task_size, mode));
+              pool->set_placement(placement);
+              pool->start(threads);
           });
-        cutl::set_current_thread_name(name_ + "_" + std::to_string(i));
-        threads_.emplace_back(std::move(thread));
+        creator.join();
+        pools.emplace_back(std::move(pool));
+    }
+    return pools;
+}
+
+void threadpool::start(const threadpool_sizing& sizing)
+{
+    if (is_running_.load())
+    {
+        CUTL_WARN("Threadpool " + name_ + " is already running");
+        return;
+    }
+
+    min_threads_ = std::max(sizing.min_threads, MIN_THREAD_NUM);
+    max_threads_ = sizing.max_threads;
+    if (max_threads_ == 0)
+    {
+        max_threads_ = std::thread::hardware_concurrency();
+    }
+    max_threads_ = std::max(max_threads_, min_threads_);
+    keep_alive_ = sizing.keep_alive;
+    elastic_ = max_threads_ > min_threads_;
+    if (elastic_)
+    {
+        CUTL_INFO("Threadpool " + name_ + " set thread num to [" + std::to_string(min_threads_) +
+                  ", " + std::to_string(max_threads_) +
+                  "], keep alive:" + std::to_string(keep_alive_.count()) + "ms");
+    }
+
+    // 为每个可能的工作线程预留一个序号(及其本地队列和统计数据)
+    free_slots_.clear();
+    worker_stats_.clear();
+    for (uint32_t i = max_threads_; i > 0; i--)
+    {
+        free_slots_.push_back(i - 1);
+        worker_stats_.emplace_back(new worker_stats());
+        if (mode_ == threadpool_mode::work_stealing)
+        {
+            worker_queues_.emplace_back(new worker_queue());
+        }
+    }
+
+    is_running_.store(true);
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        for (uint32_t i = 0; i < min_threads_; i++)
+        {
+            add_worker();
+        }
     }
     CUTL_INFO("Threadpool " + name_ + " started");
 }
@@ -78,6 +219,12 @@ void threadpool::stop(bool clear_in_destroctor)
     }
 
     is_running_.store(false);
+    // 唤醒所有等待中的工作线程和生产者
+    {
+        std::lock_guard<std::mutex> lock(task_mutex_);
+    }
+    cv_consumer_.notify_all();
+    cv_producer_.notify_all();
 
     if (!clear_in_destroctor)
     {
@@ -86,87 +233,639 @@ void threadpool::stop(bool clear_in_destroctor)
     CUTL_INFO("Threadpool " + name_ + " stopped");
 }
 
-bool threadpool::add_task(const Task& task)
+bool threadpool::add_task(Task&& task, task_priority priority)
 {
     if (!is_running_.load())
     {
+        rejected_tasks_.fetch_add(1, std::memory_order_relaxed);
         CUTL_WARN("Threadpool " + name_ + " is already stopped");
         return false;
     }
 
-    std::unique_lock<std::mutex> lock(task_mutex_);
-    // 等待，直到 队列未满 或 线程池已停止
-    cv_producer_.wait(
-      lock, [this]() { return task_queue_.size() < max_task_size_ || !is_running_.load(); });
-    task_queue_.emplace_back(std::move(task));
-    lock.unlock();
+    // 工作线程提交的任务，优先放入其本地队列
+    queued_task item{ std::move(task), enqueue_time() };
+    add_pending(1);
+    if (!push_local_task(item, priority) && !push_global_task(item, priority, nullptr))
+    {
+        pending_tasks_.fetch_sub(1);
+        rejected_tasks_.fetch_add(1, std::memory_order_relaxed);
+        CUTL_WARN("Threadpool " + name_ + " is already stopped");
+        return false;
+    }
 
     // 通知消费者消费
-    cv_consumer_.notify_one();
+    publish_tasks(1);
     return true;
 }
 
-bool threadpool::add_task(const Task& task, const Duration& timeout)
+bool threadpool::add_task(Task&& task, const Duration& timeout, task_priority priority)
 {
     if (!is_running_.load())
     {
+        rejected_tasks_.fetch_add(1, std::memory_order_relaxed);
         CUTL_WARN("Threadpool " + name_ + " is already stopped");
         return false;
     }
 
-    std::unique_lock<std::mutex> lock(task_mutex_);
-    // 等待，直到 队列未满 或 线程池已停止
-    std::chrono::steady_clock::time_point abs_timeout = std::chrono::steady_clock::now() + timeout;
-    if (!cv_producer_.wait_until(
-          lock,
-          abs_timeout,
-          [this]() { return task_queue_.size() < max_task_size_ || !is_running_.load(); }))
+    // 工作线程提交的任务，优先放入其本地队列
+    queued_task item{ std::move(task), enqueue_time() };
+    add_pending(1);
+    if (!push_local_task(item, priority) && !push_global_task(item, priority, &timeout))
     {
+        pending_tasks_.fetch_sub(1);
+        rejected_tasks_.fetch_add(1, std::memory_order_relaxed);
         CUTL_WARN("Threadpool " + name_ + " post_task_for timeout");
         return false;
     }
-    task_queue_.emplace_back(std::move(task));
-    lock.unlock();
 
     // 通知消费者消费
-    cv_consumer_.notify_one();
+    publish_tasks(1);
     return true;
 }
 
-// 从队列中取一个任务，并执行
-void threadpool::call_one_task()
+bool threadpool::add_tasks(std::vector<Task>&& tasks, task_priority priority)
 {
-    std::unique_lock<std::mutex> lock(task_mutex_);
-    if (task_queue_.empty())
+    if (!is_running_.load())
     {
-        lock.unlock();
-        cv_producer_.notify_one();
-        // CUTL_WARN("Threadpool " + name_ + " task_queue_ is empty");
-        return;
+        rejected_tasks_.fetch_add(tasks.size(), std::memory_order_relaxed);
+        CUTL_WARN("Threadpool " + name_ + " is already stopped");
+        return false;
     }
 
-    // 等待，直到 队列不为空  或 线程池已停止
-    cv_consumer_.wait(lock, [this]() { return !task_queue_.empty() || !is_running_.load(); });
-    auto task = task_queue_.front();
-    task_queue_.pop_front();
-    lock.unlock();
+    // 同一批任务使用同一个入队时间
+    auto now = enqueue_time();
+    // 工作线程提交的任务，优先放入其本地队列
+    size_t count = tasks.size();
+    size_t published = 0;
+    auto& queue = *task_queues_[static_cast<size_t>(priority)];
+    add_pending(count);
+    for (size_t i = push_local_tasks(tasks, priority, now); i < count; i++)
+    {
+        queued_task item{ std::move(tasks[i]), now };
+        if (queue.try_push(std::move(item)))
+        {
+            continue;
+        }
 
-    cv_producer_.notify_one();
-    // 执行任务
-    task();
+        // 队列已满，先通知消费者消费已入队的任务，再等待队列空位
+        publish_tasks(i - published);
+        published = i;
+        if (!push_global_task(item, priority, nullptr))
+        {
+            pending_tasks_.fetch_sub(static_cast<uint32_t>(count - i));
+            rejected_tasks_.fetch_add(count - i, std::memory_order_relaxed);
+            CUTL_WARN("Threadpool " + name_ + " is already stopped");
+            return false;
+        }
+    }
+
+    // 一次性唤醒所需数量的消费者
+    publish_tasks(count - published);
+    return true;
+}
+
+size_t threadpool::try_add_tasks(std::vector<Task>&& tasks, task_priority priority)
+{
+    if (!is_running_.load())
+    {
+        return 0;
+    }
+
+    auto now = enqueue_time();
+    size_t count = tasks.size();
+    auto& queue = *task_queues_[static_cast<size_t>(priority)];
+    add_pending(count);
+    size_t added = push_local_tasks(tasks, priority, now);
+    while (added < count)
+    {
+        // 队列已满时不等待，剩余的任务直接丢弃
+        queued_task item{ std::move(tasks[added]), now };
+        if (!queue.try_push(std::move(item)))
+        {
+            break;
+        }
+        added++;
+    }
+
+    if (added < count)
+    {
+        pending_tasks_.fetch_sub(static_cast<uint32_t>(count - added));
+    }
+    publish_tasks(added);
+    return added;
+}
+
+void threadpool::run_task(queued_task& item, uint32_t index)
+{
+    busy_workers_.fetch_add(1);
+    auto& stats = *worker_stats_[index];
+    if (stats_enabled_)
+    {
+        auto start = std::chrono::steady_clock::now();
+        stats.wait_time.record(start - item.enqueue_time);
+        item.task();
+        auto cost = std::chrono::steady_clock::now() - start;
+        stats.run_time.record(cost);
+        auto cost_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(cost).count();
+        stats.busy_ns.store(stats.busy_ns.load(std::memory_order_relaxed) + cost_ns,
+                            std::memory_order_relaxed);
+    }
+    else
+    {
+        item.task();
+    }
+    // 只有当前工作线程写入，不需要原子的读-改-写
+    stats.executed.store(stats.executed.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    busy_workers_.fetch_sub(1);
+}
+
+// 获取任务的入队时间，未开启统计时不读取时钟
+threadpool::TimePoint threadpool::enqueue_time() const
+{
+    return stats_enabled_ ? std::chrono::steady_clock::now() : TimePoint();
 }
 
 void threadpool::clear()
 {
-    for (auto& th : threads_)
+    // 在锁外join线程，避免与正在退出的空闲线程死锁
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(threads_mutex_);
+        threads.swap(threads_);
+        for (auto& th : retired_threads_)
+        {
+            threads.emplace_back(std::move(th));
+        }
+        retired_threads_.clear();
+    }
+    for (auto& th : threads)
+    {
+        if (th.joinable())
+        {
+            th.join();
+        }
+    }
+    thread_count_.store(0);
+    queued_task item;
+    for (auto& queue : task_queues_)
+    {
+        while (queue->try_pop(item))
+        {
+        }
+    }
+    worker_queues_.clear();
+    pending_tasks_.store(0);
+}
+
+// 创建一个工作线程，调用方需持有threads_mutex_
+void threadpool::add_worker()
+{
+    if (free_slots_.empty())
+    {
+        return;
+    }
+
+    // 回收已退出的空闲线程
+    for (auto& th : retired_threads_)
     {
         if (th.joinable())
         {
             th.join();
         }
     }
-    threads_.clear();
-    task_queue_.clear();
+    retired_threads_.clear();
+
+    uint32_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    // 忙碌比例按该序号上当前线程的存活时间计算
+    auto& stats = *worker_stats_[slot];
+    stats.busy_ns.store(0, std::memory_order_relaxed);
+    stats.started_ns.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now().time_since_epoch())
+                             .count(),
+                           std::memory_order_relaxed);
+    threads_.emplace_back(
+      [this, slot]()
+      {
+          cutl::set_current_thread_name(name_ + "_" + std::to_string(slot));
+          apply_thread_placement(placement_, slot);
+          worker_loop(slot);
+      });
+
+    uint32_t count = thread_count_.fetch_add(1) + 1;
+    if (count > peak_thread_count_.load())
+    {
+        peak_thread_count_.store(count);
+    }
+}
+
+// 任务积压(待执行的任务数多于空闲的线程数)时，增加一个工作线程
+void threadpool::grow_if_needed()
+{
+    uint32_t threads = thread_count_.load();
+    if (threads >= max_threads_)
+    {
+        return;
+    }
+    uint32_t free_workers = threads - std::min(threads, busy_workers_.load());
+    if (pending_tasks_.load() <= free_workers)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    if (is_running_.load() && thread_count_.load() < max_threads_)
+    {
+        add_worker();
+    }
+}
+
+// 空闲超时的工作线程退出，线程数不少于min_threads_
+bool threadpool::try_retire(uint32_t slot)
+{
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    if (!is_running_.load() || thread_count_.load() <= min_threads_)
+    {
+        return false;
+    }
+
+    auto id = std::this_thread::get_id();
+    for (auto it = threads_.begin(); it != threads_.end(); ++it)
+    {
+        if (it->get_id() == id)
+        {
+            // 线程对象交由其他线程join
+            retired_threads_.emplace_back(std::move(*it));
+            threads_.erase(it);
+            free_slots_.push_back(slot);
+            thread_count_.fetch_sub(1);
+            CUTL_INFO("Threadpool " + name_ + " worker " + std::to_string(slot) +
+                      " exits after idle for " + std::to_string(keep_alive_.count()) + "ms");
+            return true;
+        }
+    }
+    return false;
+}
+
+// 工作线程的任务调度循环
+void threadpool::worker_loop(uint32_t index)
+{
+    if (mode_ == threadpool_mode::work_stealing)
+    {
+        tls_current_pool = this;
+        tls_worker_index = index;
+    }
+
+    queued_task item;
+    uint32_t idle_rounds = 0;
+    while (is_running_.load())
+    {
+        if (pop_task(index, item))
+        {
+            run_task(item, index);
+            item.task = nullptr;
+            idle_rounds = 0;
+            continue;
+        }
+
+        // 空闲策略：先自旋，再让出CPU，最后挂起等待
+        if (idle_rounds < idle_policy_.spin_count)
+        {
+            cpu_relax();
+            idle_rounds++;
+            continue;
+        }
+        if (idle_rounds < idle_policy_.spin_count + idle_policy_.yield_count)
+        {
+            std::this_thread::yield();
+            idle_rounds++;
+            continue;
+        }
+        idle_rounds = 0;
+
+        if (!park_worker() && try_retire(index))
+        {
+            break;
+        }
+    }
+
+    tls_current_pool = nullptr;
+}
+
+// 挂起等待，直到 有新任务 或 线程池已停止 或 空闲超时(弹性伸缩时)
+// 返回false表示空闲超时
+bool threadpool::park_worker()
+{
+    std::unique_lock<std::mutex> lock(task_mutex_);
+    idle_workers_.fetch_add(1);
+    auto pred = [this]() { return pending_tasks_.load() > 0 || !is_running_.load(); };
+    bool woken = true;
+    if (elastic_)
+    {
+        woken = cv_consumer_.wait_for(lock, keep_alive_, pred);
+    }
+    else
+    {
+        cv_consumer_.wait(lock, pred);
+    }
+    idle_workers_.fetch_sub(1);
+    return woken;
+}
+
+// 当前线程是本线程池的工作线程时，将normal优先级的任务放入其本地队列
+// 其他优先级的任务需要按优先级调度，只放入全局队列
+bool threadpool::push_local_task(queued_task& item, task_priority priority)
+{
+    if (mode_ != threadpool_mode::work_stealing || tls_current_pool != this ||
+        priority != task_priority::normal)
+    {
+        return false;
+    }
+
+    auto& queue = *worker_queues_[tls_worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    // 本地队列已满，放入全局队列
+    if (queue.tasks.size() >= max_task_size_)
+    {
+        return false;
+    }
+    queue.tasks.emplace_back(std::move(item));
+    return true;
+}
+
+// 批量放入本地队列，只加一次锁，返回放入的任务数(从tasks的头部开始)
+size_t threadpool::push_local_tasks(std::vector<Task>& tasks,
+                                    task_priority priority,
+                                    TimePoint now)
+{
+    if (mode_ != threadpool_mode::work_stealing || tls_current_pool != this ||
+        priority != task_priority::normal)
+    {
+        return 0;
+    }
+
+    auto& queue = *worker_queues_[tls_worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    size_t count = 0;
+    while (count < tasks.size() && queue.tasks.size() < max_task_size_)
+    {
+        queue.tasks.emplace_back(queued_task{ std::move(tasks[count]), now });
+        count++;
+    }
+    return count;
+}
+
+// 将任务放入全局队列，队列已满时等待，直到 队列未满 或 线程池已停止 或 超时
+// timeout为nullptr时不超时
+bool threadpool::push_global_task(queued_task& item,
+                                  task_priority priority,
+                                  const Duration* timeout)
+{
+    auto& queue = *task_queues_[static_cast<size_t>(priority)];
+    if (queue.try_push(std::move(item)))
+    {
+        return true;
+    }
+
+    // 统计生产者因队列已满而阻塞的时间
+    auto block_start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(task_mutex_);
+    blocked_producers_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool pushed = false;
+    auto pred = [this, &queue, &item, &pushed]()
+    {
+        pushed = queue.try_push(std::move(item));
+        return pushed || !is_running_.load();
+    };
+    if (timeout == nullptr)
+    {
+        cv_producer_.wait(lock, pred);
+    }
+    else
+    {
+        cv_producer_.wait_until(lock, std::chrono::steady_clock::now() + *timeout, pred);
+    }
+    blocked_producers_.fetch_sub(1);
+    block_time_.record(std::chrono::steady_clock::now() - block_start);
+    return pushed;
+}
+
+// 取任务的顺序：high队列 -> 本地队列的队尾(LIFO) -> 全局队列的队头 -> 其他工作线程本地队列的队头
+// shared_queue模式只有全局队列
+bool threadpool::pop_task(uint32_t index, queued_task& item)
+{
+    if (mode_ != threadpool_mode::work_stealing)
+    {
+        return pop_global_task(item);
+    }
+
+    // 本地队列中都是normal优先级的任务，不能让其阻塞high优先级的任务
+    if (pop_lane_task(task_priority::high, item))
+    {
+        return true;
+    }
+
+    auto& local = *worker_queues_[index];
+    {
+        std::lock_guard<std::mutex> lock(local.mutex);
+        if (!local.tasks.empty())
+        {
+            item = std::move(local.tasks.back());
+            local.tasks.pop_back();
+            pending_tasks_.fetch_sub(1);
+            return true;
+        }
+    }
+
+    if (pop_global_task(item))
+    {
+        return true;
+    }
+
+    return steal_task(index, item);
+}
+
+// 按优先级从全局队列的队头取一个任务，并周期性地优先取低优先级的任务，防止其饿死
+bool threadpool::pop_global_task(queued_task& item)
+{
+    static const task_priority high_first[] = { task_priority::high,
+                                                task_priority::normal,
+                                                task_priority::low };
+    static const task_priority normal_first[] = { task_priority::normal,
+                                                  task_priority::high,
+                                                  task_priority::low };
+    static const task_priority low_first[] = { task_priority::low,
+                                               task_priority::normal,
+                                               task_priority::high };
+
+    tls_pop_round++;
+    const task_priority* order = high_first;
+    if (tls_pop_round % LOW_FIRST_INTERVAL == 0)
+    {
+        order = low_first;
+    }
+    else if (tls_pop_round % NORMAL_FIRST_INTERVAL == 0)
+    {
+        order = normal_first;
+    }
+
+    for (size_t i = 0; i < priority_count; i++)
+    {
+        if (pop_lane_task(order[i], item))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 从指定优先级队列的队头取一个任务
+bool threadpool::pop_lane_task(task_priority priority, queued_task& item)
+{
+    if (!task_queues_[static_cast<size_t>(priority)]->try_pop(item))
+    {
+        return false;
+    }
+    pending_tasks_.fetch_sub(1);
+
+    // 队列有空位了，通知等待中的生产者
+    notify_blocked_producer();
+    return true;
+}
+
+size_t threadpool::queue_size(task_priority priority) const
+{
+    return task_queues_[static_cast<size_t>(priority)]->size();
+}
+
+threadpool_stats threadpool::stats() const
+{
+    threadpool_stats result;
+    result.rejected = rejected_tasks_.load(std::memory_order_relaxed);
+    result.pending = pending_tasks_.load();
+    result.queue_high_water = queue_high_water_.load(std::memory_order_relaxed);
+    result.thread_count = thread_count_.load();
+    result.peak_thread_count = peak_thread_count_.load();
+    result.block_time = block_time_.snapshot();
+
+    std::lock_guard<std::mutex> lock(threads_mutex_);
+    auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now().time_since_epoch())
+                 .count();
+    for (uint32_t i = 0; i < worker_stats_.size(); i++)
+    {
+        auto& stats = *worker_stats_[i];
+        uint64_t executed = stats.executed.load(std::memory_order_relaxed);
+        result.executed += executed;
+        result.wait_time.merge(stats.wait_time.snapshot());
+        result.run_time.merge(stats.run_time.snapshot());
+
+        // 空闲的序号上没有运行中的工作线程
+        if (std::find(free_slots_.begin(), free_slots_.end(), i) != free_slots_.end() ||
+            !is_running_.load())
+        {
+            continue;
+        }
+        threadpool_worker_stats worker;
+        worker.index = i;
+        worker.executed = executed;
+        auto alive_ns = now - stats.started_ns.load(std::memory_order_relaxed);
+        if (alive_ns > 0)
+        {
+            worker.busy_ratio =
+              static_cast<double>(stats.busy_ns.load(std::memory_order_relaxed)) / alive_ns;
+        }
+        result.workers.emplace_back(worker);
+    }
+    return result;
+}
+
+// 从其他工作线程的本地队列窃取任务
+bool threadpool::steal_task(uint32_t index, queued_task& item)
+{
+    auto count = static_cast<uint32_t>(worker_queues_.size());
+    for (uint32_t i = 1; i < count; i++)
+    {
+        auto& victim = *worker_queues_[(index + i) % count];
+        // 不阻塞等待被窃取方的锁，获取锁失败则尝试下一个
+        std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || victim.tasks.empty())
+        {
+            continue;
+        }
+        item = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        pending_tasks_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+// 记录待执行的任务数，必须在任务入队(对消费者可见)之前调用，否则消费者可能先取出任务并减少计数，
+// 使无符号的计数回绕；入队失败时由调用者减回
+void threadpool::add_pending(size_t count)
+{
+    // 记录队列中待执行任务数的最高水位
+    uint32_t pending = pending_tasks_.fetch_add(static_cast<uint32_t>(count)) +
+                       static_cast<uint32_t>(count);
+    uint32_t high_water = queue_high_water_.load(std::memory_order_relaxed);
+    while (pending > high_water &&
+           !queue_high_water_.compare_exchange_weak(high_water, pending, std::memory_order_relaxed))
+    {
+    }
+}
+
+// 通知新入队的任务(已由add_pending计数)，唤醒所需数量的空闲工作线程
+void threadpool::publish_tasks(size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (elastic_)
+    {
+        grow_if_needed();
+    }
+
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint32_t idle = idle_workers_.load();
+    if (idle == 0)
+    {
+        return;
+    }
+
+    // 加锁保证等待中的工作线程不会错过本次通知
+    {
+        std::lock_guard<std::mutex> lock(task_mutex_);
+    }
+    if (count >= idle)
+    {
+        cv_consumer_.notify_all();
+        return;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        cv_consumer_.notify_one();
+    }
+}
+
+// 有因队列已满而等待的生产者时，唤醒其中一个
+void threadpool::notify_blocked_producer()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (blocked_producers_.load() == 0)
+    {
+        return;
+    }
+
+    // 加锁保证等待中的生产者不会错过本次通知
+    {
+        std::lock_guard<std::mutex> lock(task_mutex_);
+    }
+    cv_producer_.notify_one();
 }
 
 } // namespace cutl
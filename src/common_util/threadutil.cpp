@@ -1,6 +1,9 @@
 ﻿#include "threadutil.h"
 #include "inner/logger.h"
 #include "strutil.h"
+#include <algorithm>
+#include <fstream>
+#include <thread>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -9,6 +12,7 @@
 #include <sys/types.h>
 #else
 #include <pthread.h>
+#include <sched.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 #endif
@@ -101,4 +105,271 @@ int32_t get_current_thread_tid()
     return thread_id;
 }
 
+// 所有逻辑CPU的序号
+static std::vector<uint32_t> all_cpus()
+{
+    uint32_t count = std::max(std::thread::hardware_concurrency(), 1U);
+    std::vector<uint32_t> cpus(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        cpus[i] = i;
+    }
+    return cpus;
+}
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+// 解析Linux的CPU列表格式，如: "0-3,8,10-11"
+static std::vector<uint32_t> parse_cpu_list(const std::string& text)
+{
+    std::vector<uint32_t> cpus;
+    auto items = split(strip(text), ",");
+    for (auto& item : items)
+    {
+        if (item.empty())
+        {
+            continue;
+        }
+        auto pos = item.find('-');
+        try
+        {
+            uint32_t first = static_cast<uint32_t>(std::stoul(item.substr(0, pos)));
+            uint32_t last = pos == std::string::npos
+                              ? first
+                              : static_cast<uint32_t>(std::stoul(item.substr(pos + 1)));
+            for (uint32_t cpu = first; cpu <= last; cpu++)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            CUTL_ERROR("Invalid cpu list: " + text + ", error: " + e.what());
+            return {};
+        }
+    }
+    return cpus;
+}
+
+// 读取sysfs中的CPU列表文件
+static std::vector<uint32_t> read_cpu_list(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        return {};
+    }
+    std::string text;
+    std::getline(file, text);
+    return parse_cpu_list(text);
+}
+#endif
+
+bool set_current_thread_affinity(const std::vector<uint32_t>& cpus)
+{
+    const std::vector<uint32_t>& target = cpus.empty() ? all_cpus() : cpus;
+#if defined(_WIN32)
+    DWORD_PTR mask = 0;
+    for (auto cpu : target)
+    {
+        if (cpu >= sizeof(DWORD_PTR) * 8)
+        {
+            CUTL_WARN("Only the first " + std::to_string(sizeof(DWORD_PTR) * 8) +
+                      " CPUs are supported, ignore cpu " + std::to_string(cpu));
+            continue;
+        }
+        mask |= static_cast<DWORD_PTR>(1) << cpu;
+    }
+    if (mask == 0 || SetThreadAffinityMask(GetCurrentThread(), mask) == 0)
+    {
+        CUTL_ERROR("Failed to set thread affinity on Windows. error:" +
+                   std::to_string(GetLastError()));
+        return false;
+    }
+    return true;
+#elif defined(__APPLE__)
+    // macOS 不支持将线程绑定到指定的CPU
+    CUTL_WARN("Thread affinity is not supported on macOS");
+    return false;
+#else
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto cpu : target)
+    {
+        if (cpu >= CPU_SETSIZE)
+        {
+            CUTL_WARN("Ignore cpu " + std::to_string(cpu) + ", exceeds CPU_SETSIZE");
+            continue;
+        }
+        CPU_SET(cpu, &cpu_set);
+    }
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0)
+    {
+        CUTL_ERROR("Failed to set thread affinity on Linux. result:" + std::to_string(result));
+        return false;
+    }
+    return true;
+#endif
+}
+
+std::vector<uint32_t> get_current_thread_affinity()
+{
+    std::vector<uint32_t> cpus;
+#if defined(_WIN32)
+    // Windows 没有直接获取线程亲和性的接口，使用进程的亲和性
+    DWORD_PTR process_mask = 0;
+    DWORD_PTR system_mask = 0;
+    if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask))
+    {
+        CUTL_ERROR("Failed to get process affinity on Windows. error:" +
+                   std::to_string(GetLastError()));
+        return cpus;
+    }
+    for (uint32_t cpu = 0; cpu < sizeof(DWORD_PTR) * 8; cpu++)
+    {
+        if (process_mask & (static_cast<DWORD_PTR>(1) << cpu))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+#elif !defined(__APPLE__)
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    int result = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result != 0)
+    {
+        CUTL_ERROR("Failed to get thread affinity on Linux. result:" + std::to_string(result));
+        return cpus;
+    }
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &cpu_set))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+#endif
+    return cpus;
+}
+
+uint32_t get_numa_node_count()
+{
+#if defined(_WIN32)
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest))
+    {
+        return 1;
+    }
+    return static_cast<uint32_t>(highest) + 1;
+#elif defined(__APPLE__)
+    return 1;
+#else
+    // 节点序号可能不连续，节点数按最大的序号计算
+    auto nodes = read_cpu_list("/sys/devices/system/node/online");
+    if (nodes.empty())
+    {
+        return 1;
+    }
+    return *std::max_element(nodes.begin(), nodes.end()) + 1;
+#endif
+}
+
+std::vector<uint32_t> get_numa_node_cpus(uint32_t node)
+{
+#if defined(_WIN32)
+    ULONGLONG mask = 0;
+    if (node > 0xFF || !GetNumaNodeProcessorMask(static_cast<UCHAR>(node), &mask))
+    {
+        return node == 0 ? all_cpus() : std::vector<uint32_t>();
+    }
+    std::vector<uint32_t> cpus;
+    for (uint32_t cpu = 0; cpu < 64; cpu++)
+    {
+        if (mask & (1ULL << cpu))
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+#elif defined(__APPLE__)
+    return node == 0 ? all_cpus() : std::vector<uint32_t>();
+#else
+    auto cpus = read_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (cpus.empty() && node == 0 && get_numa_node_count() == 1)
+    {
+        // 没有NUMA信息时，所有CPU都属于节点0
+        return all_cpus();
+    }
+    return cpus;
+#endif
+}
+
+std::vector<uint32_t> get_thread_placement_cpus(const thread_placement& placement,
+                                                uint32_t index)
+{
+    switch (placement.mode)
+    {
+        case thread_placement_mode::cpu_list:
+        {
+            if (placement.cpus.empty())
+            {
+                return {};
+            }
+            return { placement.cpus[index % placement.cpus.size()] };
+        }
+        case thread_placement_mode::spread:
+        {
+            // 轮流从各个节点取CPU: node0的第0个, node1的第0个, node0的第1个, ...
+            std::vector<std::vector<uint32_t>> node_cpus;
+            size_t total = 0;
+            for (uint32_t node = 0; node < get_numa_node_count(); node++)
+            {
+                auto cpus = get_numa_node_cpus(node);
+                total += cpus.size();
+                if (!cpus.empty())
+                {
+                    node_cpus.emplace_back(std::move(cpus));
+                }
+            }
+            if (total == 0)
+            {
+                return {};
+            }
+            std::vector<uint32_t> order;
+            order.reserve(total);
+            for (size_t i = 0; order.size() < total; i++)
+            {
+                for (auto& cpus : node_cpus)
+                {
+                    if (i < cpus.size())
+                    {
+                        order.push_back(cpus[i]);
+                    }
+                }
+            }
+            return { order[index % order.size()] };
+        }
+        case thread_placement_mode::compact:
+            return get_numa_node_cpus(placement.numa_node);
+        default:
+            return {};
+    }
+}
+
+bool apply_thread_placement(const thread_placement& placement, uint32_t index)
+{
+    if (placement.mode == thread_placement_mode::none)
+    {
+        return true;
+    }
+
+    auto cpus = get_thread_placement_cpus(placement, index);
+    if (cpus.empty())
+    {
+        CUTL_WARN("No cpu for the thread placement, index:" + std::to_string(index));
+        return false;
+    }
+    return set_current_thread_affinity(cpus);
+}
+
 } // namespace cutl
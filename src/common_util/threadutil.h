@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace cutl
 {
@@ -27,4 +28,87 @@ std::string get_current_thread_name();
  */
 int32_t get_current_thread_tid();
 
+/**
+ * @brief Bind the current thread to the given CPUs.
+ * @note Only supported on Linux and Windows (the first 64 CPUs), it does nothing and returns false
+ * on the other platforms.
+ *
+ * @param cpus the indexes of the logical CPUs, the empty list means all the CPUs
+ * @return true if success, false otherwise.
+ */
+bool set_current_thread_affinity(const std::vector<uint32_t>& cpus);
+
+/**
+ * @brief Get the CPUs which the current thread is allowed to run on.
+ *
+ * @return std::vector<uint32_t> the indexes of the logical CPUs, empty if it is not supported.
+ */
+std::vector<uint32_t> get_current_thread_affinity();
+
+/**
+ * @brief Get the number of the NUMA nodes.
+ *
+ * @return uint32_t the number of the NUMA nodes, 1 if NUMA is not supported.
+ */
+uint32_t get_numa_node_count();
+
+/**
+ * @brief Get the CPUs of a NUMA node.
+ *
+ * @param node the index of the NUMA node
+ * @return std::vector<uint32_t> the indexes of the logical CPUs of the node. If NUMA is not
+ * supported, all the CPUs belong to node 0.
+ */
+std::vector<uint32_t> get_numa_node_cpus(uint32_t node);
+
+/**
+ * @brief The CPU placement mode of the threads.
+ *
+ */
+enum class thread_placement_mode
+{
+    /** Not bound, the threads are scheduled by the OS */
+    none,
+    /** The i-th thread is bound to cpus[i % cpus.size()] */
+    cpu_list,
+    /** The threads are bound to one CPU each, alternating between the NUMA nodes */
+    spread,
+    /** All the threads are bound to the CPUs of one NUMA node */
+    compact,
+};
+
+/**
+ * @brief The CPU placement policy of a group of threads, such as the workers of a threadpool.
+ *
+ */
+struct thread_placement
+{
+    /** The placement mode */
+    thread_placement_mode mode = thread_placement_mode::none;
+    /** The CPU list, used by thread_placement_mode::cpu_list */
+    std::vector<uint32_t> cpus;
+    /** The NUMA node, used by thread_placement_mode::compact */
+    uint32_t numa_node = 0;
+};
+
+/**
+ * @brief Get the CPUs which the index-th thread of a group should be bound to.
+ *
+ * @param placement the placement policy of the group
+ * @param index the index of the thread in the group
+ * @return std::vector<uint32_t> the indexes of the logical CPUs, empty means not bound.
+ */
+std::vector<uint32_t> get_thread_placement_cpus(const thread_placement& placement,
+                                                uint32_t index);
+
+/**
+ * @brief Bind the current thread according to the placement policy.
+ *
+ * @param placement the placement policy of the group
+ * @param index the index of the current thread in the group
+ * @return true if the thread is bound or the mode is thread_placement_mode::none, false
+ * otherwise.
+ */
+bool apply_thread_placement(const thread_placement& placement, uint32_t index);
+
 } // namespace cutl
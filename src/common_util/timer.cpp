@@ -1,114 +1,455 @@
 ﻿#include "timer.h"
+#include "inner/io_poller.h"
 #include "inner/logger.h"
+#include "inner/timer_queue.h"
 #include "threadutil.h"
 
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 namespace cutl
 {
 
-timer::timer(const std::string& name, Task task, Duration interval)
-  : running_(false)
-  , name_(name)
-  , task_(std::move(task))
-  , interval_(interval)
+// 定时器的统计数据，只在服务线程中修改，跨越多次start/stop保留
+struct timer_counters
 {
+    std::atomic<uint64_t> run_count{ 0 };
+    std::atomic<uint64_t> skipped_count{ 0 };
+    std::atomic<int64_t> last_lateness_ns{ 0 };
+    std::atomic<int64_t> max_lateness_ns{ 0 };
+    std::atomic<int64_t> total_lateness_ns{ 0 };
+};
+
+// timer_service中的定时任务，复用eventloop的定时任务队列(最小堆或时间轮)
+struct timer_entry : public TimerTask
+{
+    timer_entry(const std::string& name,
+                const EventloopTimePoint& next_run_time,
+                const EventloopDuration& period,
+                const EventloopTimerFunc& func,
+                timer_mode mode,
+                const std::shared_ptr<timer_counters>& counters,
+                int64_t repeat = -1)
+      : TimerTask(nullptr, name, next_run_time, period, func, repeat)
+      , mode_(mode)
+      , counters_(counters)
+    {
+    }
+
+    // 记录本次执行的延迟，set_timeout等没有统计数据的任务不记录
+    void record_lateness(EventloopTimePoint now)
+    {
+        if (!counters_)
+        {
+            return;
+        }
+        auto lateness =
+          std::chrono::duration_cast<std::chrono::nanoseconds>(now - next_run_time_).count();
+        if (lateness < 0)
+        {
+            lateness = 0;
+        }
+        counters_->run_count.fetch_add(1, std::memory_order_relaxed);
+        counters_->last_lateness_ns.store(lateness, std::memory_order_relaxed);
+        counters_->total_lateness_ns.fetch_add(lateness, std::memory_order_relaxed);
+        if (lateness > counters_->max_lateness_ns.load(std::memory_order_relaxed))
+        {
+            counters_->max_lateness_ns.store(lateness, std::memory_order_relaxed);
+        }
+    }
+
+    // 执行完毕后计算下一次执行的时间
+    void schedule_next(EventloopTimePoint now)
+    {
+        if (mode_ == timer_mode::fixed_delay)
+        {
+            next_run_time_ = now + period_;
+            return;
+        }
+
+        next_run_time_ += period_;
+        if (next_run_time_ < now && period_ > EventloopDuration::zero())
+        {
+            // 执行时间超过了若干个完整的周期，跳过错过的周期，剩余的一次立即执行，保持原有的相位
+            auto missed = (now - next_run_time_) / period_;
+            if (missed > 0)
+            {
+                next_run_time_ += missed * period_;
+                if (counters_)
+                {
+                    counters_->skipped_count.fetch_add(missed, std::memory_order_relaxed);
+                }
+                CUTL_WARN("Timer [" + name_ + "] The current time exceeds the expected time. period:" +
+                          std::to_string(std::chrono::duration_cast<std::chrono::microseconds>(period_)
+                                           .count()) +
+                          "us, skipped:" + std::to_string(missed));
+            }
+        }
+    }
+
+    timer_mode mode_;
+    std::shared_ptr<timer_counters> counters_;
+};
+
+// 自旋等待时降低CPU的功耗和对超线程的影响
+static inline void cpu_relax()
+{
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+    _mm_pause();
+#elif defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield");
+#endif
 }
 
-timer::~timer()
+timer_handle::timer_handle(timer_service* service, const std::shared_ptr<timer_entry>& entry)
+  : service_(service)
+  , entry_(entry)
+{
+}
+
+void timer_handle::cancel()
+{
+    auto entry = entry_.lock();
+    if (entry && service_ != nullptr)
+    {
+        service_->remove(entry, false);
+    }
+    entry_.reset();
+}
+
+bool timer_handle::is_valid() const
+{
+    auto entry = entry_.lock();
+    return entry && entry->is_valid();
+}
+
+timer_service::timer_service(const std::string& name, const timer_service_options& options)
+  : name_(name)
+  , options_(options)
+  , running_(false)
+  , thread_id_()
+  , executing_(nullptr)
+  , poller_(create_io_poller())
+  , wakeup_pending_(false)
+{
+    if (options_.queue.backend == eventloop_timer_backend::timing_wheel)
+    {
+        queue_.reset(new wheel_timer_queue(
+          options_.queue.tick, options_.queue.wheel_slots, options_.queue.wheel_levels));
+    }
+    else
+    {
+        queue_.reset(new heap_timer_queue());
+    }
+}
+
+timer_service::~timer_service()
 {
+    // 之前在定时任务的回调中停止过时，也会等待线程退出
     stop();
 }
 
-void timer::start()
+timer_service& timer_service::default_service()
+{
+    // 不析构: 静态对象中的定时器在退出时仍可以安全地停止
+    static timer_service* service = new timer_service("cutl-timer");
+    service->start();
+    return *service;
+}
+
+void timer_service::start()
 {
     if (running_.load())
     {
         return;
     }
+    if (thread_id_.load() == std::this_thread::get_id())
+    {
+        // 在回调中停止后又重新启动，服务线程还在运行，继续使用即可(不加锁，其它线程可能正持有锁等待本线程)
+        running_.store(true);
+        return;
+    }
 
-    // 防止上一次的暂停(stop)还未结束
+    // 多个线程同时启动(如default_service)时，只有一个线程等待旧线程退出并创建新线程
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (running_.load())
+    {
+        return;
+    }
     if (thread_.joinable())
     {
+        // 在定时任务的回调中调用stop()时没有等待线程退出，重新启动前等待
         thread_.join();
     }
-
-    CUTL_INFO("timer [" + name_ + "] starting...");
-
-    // 启动线程
     running_.store(true);
-    thread_ = std::thread(&timer::run, this);
-
-    CUTL_INFO("Timer [" + name_ + "] started.");
+    thread_ = std::thread(
+      [this]()
+      {
+          set_current_thread_name(name_);
+          thread_id_.store(std::this_thread::get_id());
+          run();
+          // 线程退出后清除，线程id可能被之后创建的其它线程复用
+          thread_id_.store(std::thread::id());
+      });
 }
 
-void timer::stop(bool wait_for_stop)
+void timer_service::stop()
 {
-    if (!running_)
+    if (thread_id_.load() == std::this_thread::get_id())
     {
+        // 在定时任务的回调中停止时不能等待自己退出(join会抛出异常)，线程在回调返回后自行退出
+        if (running_.exchange(false))
+        {
+            wakeup();
+        }
         return;
     }
 
-    CUTL_INFO("Timer [" + name_ + "] stoping...");
+    std::lock_guard<std::mutex> lock(lifecycle_mutex_);
+    if (running_.exchange(false))
+    {
+        wakeup();
+    }
+    // 包括之前在回调中停止、尚未等待的线程
+    if (thread_.joinable())
+    {
+        thread_.join();
+    }
+}
+
+size_t timer_service::timer_count() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_->size();
+}
+
+timer_handle timer_service::run_after(EventloopDuration delay, const EventloopTimerFunc& func)
+{
+    // 不使用make_shared: timer_handle的弱引用会使make_shared分配的内存在任务销毁后仍无法释放
+    std::shared_ptr<timer_entry> entry(new timer_entry("timeout",
+                                                       std::chrono::steady_clock::now() + delay,
+                                                       delay,
+                                                       func,
+                                                       timer_mode::fixed_rate,
+                                                       nullptr,
+                                                       1));
+    start();
+    add(entry);
+    return timer_handle(this, entry);
+}
 
-    // running_标致设置为false, 并通知线程退出
-    running_.store(false);
-    cv_stopping_.notify_one();
-    // cv_stopping_.notify_all();
+timer_handle timer_service::run_every(EventloopDuration interval,
+                                      const EventloopTimerFunc& func,
+                                      timer_mode mode)
+{
+    std::shared_ptr<timer_entry> entry(new timer_entry(
+      "interval", std::chrono::steady_clock::now() + interval, interval, func, mode, nullptr));
+    start();
+    add(entry);
+    return timer_handle(this, entry);
+}
 
-    // 等待线程退出
-    if (wait_for_stop && thread_.joinable())
+void timer_service::add(const std::shared_ptr<timer_entry>& entry)
+{
+    bool earliest = false;
     {
-        thread_.join();
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        // 服务线程等待的是当前最早的到期时间，新任务更早到期时才需要唤醒(系统调用)
+        earliest = queue_->size() == 0 ||
+                   entry->next_run_time_ < now + queue_->next_timeout(now, std::chrono::seconds(1));
+        queue_->push(entry);
+    }
+    if (earliest)
+    {
+        wakeup();
     }
+}
 
-    CUTL_INFO("Timer [" + name_ + "] stoped.");
+void timer_service::remove(const std::shared_ptr<timer_entry>& entry, bool wait)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    entry->cancel();
+    // 已被取出等待执行的任务不在队列中，执行前会检查是否已取消
+    queue_->remove(entry.get());
+
+    // 在定时任务的回调中停止自己时不能等待，否则会死锁
+    if (wait && thread_id_.load() != std::this_thread::get_id())
+    {
+        executed_cv_.wait(lock, [this, &entry]() { return executing_ != entry.get(); });
+    }
 }
 
-void timer::run()
+void timer_service::wakeup()
 {
-    // 设置线程名称
-    set_current_thread_name(name_);
+    if (poller_)
+    {
+        poller_->wakeup();
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    wakeup_pending_ = true;
+    wakeup_cv_.notify_one();
+}
 
-    current_period_start_ = std::chrono::steady_clock::now();
+void timer_service::wait_for(std::unique_lock<std::mutex>& lock, EventloopDuration timeout)
+{
+    if (poller_)
+    {
+        lock.unlock();
+        poller_->wait(timeout);
+        lock.lock();
+        return;
+    }
+    wakeup_cv_.wait_for(lock, timeout, [this]() { return wakeup_pending_ || !running_.load(); });
+    wakeup_pending_ = false;
+}
 
+void timer_service::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
     while (running_.load())
     {
-        // 执行任务
-        task_();
-
-        // 期望执行的时间
-        auto expected_end_time = current_period_start_ + interval_;
-        // 任务开始执行时的时间
         auto now = std::chrono::steady_clock::now();
-        if (now >= expected_end_time)
+        auto timeout = queue_->next_timeout(now, std::chrono::seconds(1));
+        if (timeout <= EventloopDuration::zero())
         {
-            auto delta =
-              std::chrono::duration_cast<std::chrono::nanoseconds>(expected_end_time - now)
-                .count();
-            CUTL_WARN("Timer [" + name_ + "] The current time exceeds the expected time. period:" +
-                      std::to_string(interval_.count()) + "us, delta:" + std::to_string(delta) +
-                      "us");
-            current_period_start_ = now;
+            run_expired(lock);
             continue;
         }
 
-        // 等待下一此执行
-        auto sleep_time = expected_end_time - now;
-        // std::this_thread::sleep_for(sleep_time);
-        // current_period_start_ = std::chrono::steady_clock::now();
+        if (!options_.high_resolution || timeout > options_.spin_threshold)
+        {
+            // 高精度模式下提前醒来，剩余的时间自旋等待
+            wait_for(lock, options_.high_resolution ? timeout - options_.spin_threshold : timeout);
+            continue;
+        }
+
+        // 自旋等待到期，期间新添加的定时任务最多延迟spin_threshold
+        lock.unlock();
+        auto deadline = now + timeout;
+        while (std::chrono::steady_clock::now() < deadline && running_.load())
+        {
+            cpu_relax();
+        }
+        lock.lock();
+    }
+}
 
-        std::unique_lock<std::mutex> lock(mutex_stopping_);
-        if (cv_stopping_.wait_until(
-              lock, expected_end_time, [this]() { return !running_.load(); }))
+void timer_service::run_expired(std::unique_lock<std::mutex>& lock)
+{
+    eventloop::TimerTaskVec ready;
+    queue_->pop_expired(std::chrono::steady_clock::now(), ready);
+    for (auto& task : ready)
+    {
+        auto entry = std::static_pointer_cast<timer_entry>(task);
+        // 等待执行期间被停止
+        if (!entry->is_valid())
         {
-            // 收到了 stop 的消息
-            // std::cout << "received stop message" << std::endl;
+            continue;
         }
-        else
+
+        executing_ = entry.get();
+        lock.unlock();
+
+        entry->record_lateness(std::chrono::steady_clock::now());
+        entry->func_();
+
+        auto now = std::chrono::steady_clock::now();
+        lock.lock();
+        executing_ = nullptr;
+        // 单次任务(set_timeout)执行后失效；执行期间被停止(包括在回调中停止自己)时不再调度
+        entry->update_left_times();
+        if (entry->is_valid())
         {
-            // 等待超时，更新下一个执行时间
-            current_period_start_ += interval_;
+            entry->schedule_next(now);
+            queue_->push(entry);
         }
+        executed_cv_.notify_all();
+    }
+}
+
+timer::timer(const std::string& name,
+             Task task,
+             Duration interval,
+             timer_mode mode,
+             timer_service* service)
+  : name_(name)
+  , task_(std::move(task))
+  , interval_(interval)
+  , mode_(mode)
+  , service_(service)
+  , counters_(std::make_shared<timer_counters>())
+{
+}
+
+timer::~timer()
+{
+    stop();
+}
+
+void timer::start()
+{
+    if (is_running())
+    {
+        return;
+    }
+
+    CUTL_INFO("timer [" + name_ + "] starting...");
+
+    if (service_ == nullptr)
+    {
+        service_ = &timer_service::default_service();
+    }
+    service_->start();
+
+    // 启动后立即执行一次，之后每个周期执行一次
+    entry_ = std::make_shared<timer_entry>(
+      name_, std::chrono::steady_clock::now(), interval_, task_, mode_, counters_);
+    service_->add(entry_);
+
+    CUTL_INFO("Timer [" + name_ + "] started.");
+}
+
+void timer::stop(bool wait_for_stop)
+{
+    if (!is_running())
+    {
+        return;
+    }
+
+    CUTL_INFO("Timer [" + name_ + "] stoping...");
+
+    // 从服务中移除，并等待正在执行的任务结束
+    service_->remove(entry_, wait_for_stop);
+
+    CUTL_INFO("Timer [" + name_ + "] stoped.");
+}
+
+bool timer::is_running() const
+{
+    return entry_ && entry_->is_valid();
+}
+
+timer_stats timer::stats() const
+{
+    timer_stats stats;
+    stats.run_count = counters_->run_count.load(std::memory_order_relaxed);
+    stats.skipped_count = counters_->skipped_count.load(std::memory_order_relaxed);
+    stats.last_lateness =
+      std::chrono::nanoseconds(counters_->last_lateness_ns.load(std::memory_order_relaxed));
+    stats.max_lateness =
+      std::chrono::nanoseconds(counters_->max_lateness_ns.load(std::memory_order_relaxed));
+    if (stats.run_count > 0)
+    {
+        stats.mean_lateness = std::chrono::nanoseconds(
+          counters_->total_lateness_ns.load(std::memory_order_relaxed) /
+          static_cast<int64_t>(stats.run_count));
     }
+    return stats;
 }
 
 } // namespace cutl
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "common.hpp"
+#include "common_util/cachepolicy.h"
+#include "common_util/hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <vector>
+
+void case_policy_cache()
+{
+    PrintSubTitle("policy cache");
+
+    // 容量为100，先写入热点数据并多次访问
+    cutl::policy_cache<int, std::string, std::hash<int>, cutl::wtinylfu_policy<int>> cache(100);
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < 50; i++)
+        {
+            if (cache.get(i).empty())
+            {
+                cache.put(i, "hot-" + std::to_string(i));
+            }
+        }
+    }
+    // 一次扫描: 大量只访问一次的key
+    for (int i = 1000; i < 3000; i++)
+    {
+        cache.put(i, "scan-" + std::to_string(i));
+    }
+
+    int hot_count = 0;
+    for (int i = 0; i < 50; i++)
+    {
+        hot_count += cache.exist(i) ? 1 : 0;
+    }
+    std::cout << "size: " << cache.size() << ", hot keys kept after the scan: " << hot_count << "/50"
+              << std::endl;
+    std::cout << "get(7): " << cache.get(7) << std::endl;
+}
+
+// 按访问记录(trace)驱动淘汰策略，未命中时插入，返回命中率
+template<typename Policy>
+double simulate_hit_ratio(const std::vector<uint64_t>& trace, size_t capacity)
+{
+    Policy policy(capacity);
+    std::vector<uint64_t> evicted;
+    uint64_t hits = 0;
+    for (uint64_t key : trace)
+    {
+        if (policy.touch(key))
+        {
+            hits++;
+        }
+        else
+        {
+            evicted.clear();
+            policy.insert(key, evicted);
+        }
+    }
+    return trace.empty() ? 0.0 : 100.0 * hits / trace.size();
+}
+
+// 读取访问记录文件: 每行一个key，数字直接使用，其它字符串使用FNV-1a哈希
+std::vector<uint64_t> load_cache_trace(const std::string& path)
+{
+    std::vector<uint64_t> trace;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        char* end = nullptr;
+        uint64_t key = std::strtoull(line.c_str(), &end, 10);
+        trace.push_back(*end == '\0' ? key : cutl::hash_fnv1a_64(line));
+    }
+    return trace;
+}
+
+// 合成访问记录: Zipf分布的热点访问，每隔scan_interval次访问插入一次全量扫描(只访问一次的key)
+std::vector<uint64_t> make_scan_trace(size_t length, size_t scan_interval, size_t scan_length)
+{
+    const int key_count = 50000;
+    std::vector<double> cdf(key_count);
+    double sum = 0;
+    for (int i = 0; i < key_count; i++)
+    {
+        sum += 1.0 / std::pow(i + 1, 0.9);
+        cdf[i] = sum;
+    }
+
+    std::mt19937 rng(2026);
+    std::uniform_real_distribution<double> dist(0, sum);
+    std::vector<uint64_t> trace;
+    uint64_t scan_key = key_count;
+    while (trace.size() < length)
+    {
+        if (trace.size() % scan_interval == scan_interval - 1)
+        {
+            for (size_t i = 0; i < scan_length; i++)
+            {
+                trace.push_back(scan_key++);
+            }
+        }
+        trace.push_back(std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin());
+    }
+    return trace;
+}
+
+void BenchmarkCachePolicy(const std::string& trace_file = "")
+{
+    PrintSubTitle("benchmark: hit ratio of the eviction policies");
+
+    std::vector<uint64_t> trace;
+    if (trace_file.empty())
+    {
+        trace = make_scan_trace(2000000, 200000, 100000);
+        std::cout << "synthetic trace (zipf 0.9 with periodic scans), ";
+    }
+    else
+    {
+        trace = load_cache_trace(trace_file);
+        std::cout << "trace file " << trace_file << ", ";
+    }
+    std::cout << trace.size() << " requests" << std::endl;
+
+    std::cout << std::setw(10) << "capacity" << std::setw(10) << "LRU" << std::setw(10) << "2Q"
+              << std::setw(10) << "ARC" << std::setw(12) << "W-TinyLFU" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    for (size_t capacity : { 1000, 5000, 20000 })
+    {
+        std::cout << std::setw(10) << capacity << std::setw(9)
+                  << simulate_hit_ratio<cutl::lru_policy<uint64_t>>(trace, capacity) << "%"
+                  << std::setw(9)
+                  << simulate_hit_ratio<cutl::two_queue_policy<uint64_t>>(trace, capacity) << "%"
+                  << std::setw(9) << simulate_hit_ratio<cutl::arc_policy<uint64_t>>(trace, capacity)
+                  << "%" << std::setw(11)
+                  << simulate_hit_ratio<cutl::wtinylfu_policy<uint64_t>>(trace, capacity) << "%"
+                  << std::endl;
+    }
+    std::cout.unsetf(std::ios::fixed);
+}
+
+void TestCachePolicy()
+{
+    PrintTitle("Cache Eviction Policy Usage Demo");
+
+    case_policy_cache();
+    // 可以传入记录的访问文件(每行一个key)，比较各策略的命中率
+    // BenchmarkCachePolicy("cache_trace.txt");
+    // BenchmarkCachePolicy();
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include "common.hpp"
+#include "common_util/coroutine.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if CUTL_HAS_COROUTINE
+
+// 模拟一次异步查询: 在io事件循环上等待一段时间后返回结果
+cutl::task<int> query_async(cutl::eventloop& io_loop, int id)
+{
+    co_await cutl::switch_to(io_loop);
+    co_await cutl::sleep_for(io_loop, std::chrono::milliseconds(50 + id * 10));
+    co_return id * 100;
+}
+
+// 多步骤的异步流程: 不需要嵌套post_event和post_timer_event的回调
+cutl::task<std::string> pipeline_async(cutl::eventloop& io_loop, cutl::eventloop& work_loop)
+{
+    int first = co_await query_async(io_loop, 1);
+    std::cout << "query 1 done in thread " << std::this_thread::get_id() << std::endl;
+
+    // 并发执行多个查询，全部完成后继续
+    std::vector<cutl::task<int>> queries;
+    for (int id = 2; id <= 4; id++)
+    {
+        queries.push_back(query_async(io_loop, id));
+    }
+    auto results = co_await cutl::when_all(std::move(queries));
+
+    // 切换到计算线程处理结果
+    co_await cutl::switch_to(work_loop);
+    int sum = first;
+    for (int value : results)
+    {
+        sum += value;
+    }
+    std::cout << "sum in thread " << std::this_thread::get_id() << std::endl;
+    co_return "sum: " + std::to_string(sum);
+}
+
+// 很短的等待: 定时任务可能在投递返回之前就已到期并恢复协程
+cutl::task<int> short_sleeps_async(cutl::eventloop& io_loop, int count)
+{
+    int done = 0;
+    for (int i = 0; i < count; i++)
+    {
+        co_await cutl::sleep_for(io_loop, std::chrono::nanoseconds(i % 2));
+        done++;
+    }
+    co_return done;
+}
+
+void TestCoroutine()
+{
+    PrintTitle("Test Coroutine");
+
+    cutl::singlethread_eventloop io_loop("IoLoop");
+    cutl::singlethread_eventloop work_loop("WorkLoop");
+    io_loop.start();
+    work_loop.start();
+
+    std::cout << "main thread " << std::this_thread::get_id() << std::endl;
+    std::cout << cutl::sync_wait(pipeline_async(io_loop, work_loop)) << std::endl;
+
+    // 每次sync_wait都从主线程开始等待，0ns和1ns交替
+    int sleeps = 0;
+    for (int i = 0; i < 500; i++)
+    {
+        sleeps += cutl::sync_wait(short_sleeps_async(io_loop, 2));
+    }
+    std::cout << "short sleeps done: " << sleeps << std::endl;
+
+    io_loop.stop();
+    work_loop.stop();
+}
+
+#else
+
+void TestCoroutine()
+{
+    PrintTitle("Test Coroutine");
+    std::cout << "C++20 coroutines are not supported by the compiler" << std::endl;
+}
+
+#endif
@@ -1,6 +1,14 @@
 ﻿#include "common.hpp"
 #include "common_util/datetime.h"
 #include "common_util/eventloop.h"
+#include <atomic>
+#include <ctime>
+#include <mutex>
+#include <vector>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 void test_eventloop()
 {
@@ -131,6 +139,294 @@ void test_multithread_eventloop()
     std::cout << "main thread exit" << std::endl;
 }
 
+// 投递count个单次定时任务(到期时间均匀分布在[200ms, 1200ms])，统计投递耗时、CPU时间和到期延迟
+void benchmark_timer_backend(const std::string& name,
+                             const cutl::eventloop_timer_options& options,
+                             uint32_t count)
+{
+    cutl::singlethread_eventloop loop("TimerBench", 16, count + 16);
+    loop.set_timer_options(options);
+    loop.start();
+
+    std::atomic<uint32_t> fired(0);
+    std::atomic<int64_t> total_late_us(0);
+    std::atomic<int64_t> max_late_us(0);
+    std::clock_t cpu_start = std::clock();
+    auto post_start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        auto delay = std::chrono::milliseconds(200 + i % 1000);
+        auto deadline = std::chrono::steady_clock::now() + delay;
+        loop.post_timer_event(
+          "conn_timeout",
+          [&, deadline]()
+          {
+              auto late = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - deadline)
+                            .count();
+              total_late_us += late;
+              if (late > max_late_us.load())
+              {
+                  max_late_us.store(late);
+              }
+              fired++;
+          },
+          delay,
+          1);
+    }
+    auto post_cost = std::chrono::steady_clock::now() - post_start;
+
+    while (fired.load() < count)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    double cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    loop.stop();
+
+    auto post_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(post_cost).count();
+    std::cout << name << " timers: " << count << ", post(ns/timer): " << post_ns / count
+              << ", cpu(ms): " << cpu_ms << ", mean late(us): " << total_late_us.load() / count
+              << ", max late(us): " << max_late_us.load() << std::endl;
+}
+
+void benchmark_timer_backends()
+{
+    PrintSubTitle("benchmark: heap vs timing wheel");
+
+    cutl::eventloop_timer_options heap;
+    cutl::eventloop_timer_options wheel;
+    wheel.backend = cutl::eventloop_timer_backend::timing_wheel;
+    wheel.tick = std::chrono::milliseconds(1);
+
+    for (uint32_t count : { 10000U, 100000U, 1000000U })
+    {
+        benchmark_timer_backend("heap ", heap, count);
+        benchmark_timer_backend("wheel", wheel, count);
+    }
+}
+
+// 模拟请求超时: 大量超时定时器在到期前被取消，被取消的定时器立即从队列中移除
+void benchmark_timer_cancel(const std::string& name,
+                            const cutl::eventloop_timer_options& options,
+                            uint32_t count)
+{
+    cutl::singlethread_eventloop loop("TimerCancel", 16, count + 16);
+    loop.set_timer_options(options);
+    loop.start();
+
+    std::vector<cutl::timer_task_handler> handlers;
+    handlers.reserve(count);
+    auto post_start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        handlers.emplace_back(loop.post_timer_event(
+          "request_timeout", []() {}, std::chrono::seconds(30), 1));
+    }
+    auto post_cost = std::chrono::steady_clock::now() - post_start;
+    size_t posted = loop.timer_count();
+
+    // 99%的请求在超时前完成，取消其超时定时器
+    auto cancel_start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i % 100 != 0)
+        {
+            handlers[i].cancel();
+        }
+    }
+    auto cancel_cost = std::chrono::steady_clock::now() - cancel_start;
+    loop.stop();
+
+    auto post_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(post_cost).count();
+    auto cancel_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(cancel_cost).count();
+    std::cout << name << " timers: " << posted << ", post(ns/timer): " << post_ns / count
+              << ", cancel(ns/timer): " << cancel_ns / loop.cancelled_timer_count()
+              << ", canceled: " << loop.cancelled_timer_count()
+              << ", live after cancel: " << loop.timer_count() << std::endl;
+}
+
+void benchmark_timer_cancels()
+{
+    PrintSubTitle("benchmark: cancel timers");
+
+    cutl::eventloop_timer_options heap;
+    cutl::eventloop_timer_options wheel;
+    wheel.backend = cutl::eventloop_timer_backend::timing_wheel;
+
+    for (uint32_t count : { 10000U, 100000U, 1000000U })
+    {
+        benchmark_timer_cancel("heap ", heap, count);
+        benchmark_timer_cancel("wheel", wheel, count);
+    }
+}
+
+#if defined(__linux__)
+// 在事件循环线程中同时处理IO事件、普通任务和定时任务
+void test_eventloop_fd()
+{
+    PrintSubTitle("eventloop watch fd");
+
+    cutl::singlethread_eventloop loop("FdLoop");
+    loop.start();
+
+    int fds[2] = { -1, -1 };
+    if (pipe(fds) != 0)
+    {
+        std::cout << "create pipe failed" << std::endl;
+        return;
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+
+    std::atomic<int> total(0);
+    bool ret = loop.add_fd(fds[0],
+                           cutl::fd_event_read,
+                           [&](int fd, uint32_t events)
+                           {
+                               char buf[64];
+                               ssize_t n = 0;
+                               while ((n = read(fd, buf, sizeof(buf))) > 0)
+                               {
+                                   total += static_cast<int>(n);
+                               }
+                               // 写端关闭
+                               if (events & cutl::fd_event_error)
+                               {
+                                   std::cout << "pipe closed, read bytes: " << total.load()
+                                             << std::endl;
+                                   loop.remove_fd(fd);
+                               }
+                           });
+    std::cout << "add_fd: " << ret << std::endl;
+
+    loop.post_timer_event(
+      "writer",
+      [&fds]()
+      {
+          ssize_t n = write(fds[1], "hello", 5);
+          (void)n;
+      },
+      std::chrono::milliseconds(100),
+      5);
+    std::this_thread::sleep_for(std::chrono::milliseconds(800));
+    close(fds[1]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    loop.stop();
+    close(fds[0]);
+}
+#endif
+
+// 队列满时的溢出策略，以及高低水位通知
+void test_eventloop_overflow()
+{
+    PrintSubTitle("eventloop overflow policy");
+
+    cutl::singlethread_eventloop loop("OverflowLoop", 8);
+    cutl::eventloop_queue_options options;
+    options.overflow = cutl::eventloop_overflow_policy::block;
+    options.block_timeout = std::chrono::milliseconds(50);
+    options.high_watermark = 6;
+    options.low_watermark = 2;
+    options.on_high_watermark = [](size_t size)
+    { std::cout << "high watermark, queue size: " << size << std::endl; };
+    options.on_low_watermark = [](size_t size)
+    { std::cout << "low watermark, queue size: " << size << std::endl; };
+    loop.set_queue_options(options);
+    loop.start();
+
+    int timeouts = 0;
+    for (int i = 0; i < 20; i++)
+    {
+        auto status = loop.post_event(
+          []() { std::this_thread::sleep_for(std::chrono::milliseconds(10)); });
+        if (status == cutl::eventloop_post_status::timeout)
+        {
+            timeouts++;
+        }
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::cout << "timeouts: " << timeouts << ", dropped: " << loop.dropped_count() << std::endl;
+    loop.stop();
+}
+
+// 每个线程一个事件循环，同一个会话的事件总是在同一个线程中按顺序处理
+void test_eventloop_group()
+{
+    PrintSubTitle("eventloop group");
+
+    cutl::eventloop_group group("Reactor", 4, 1024);
+    group.start();
+
+    std::mutex mtx;
+    for (int session = 0; session < 4; session++)
+    {
+        for (int seq = 0; seq < 3; seq++)
+        {
+            group.post_event_by_key(session,
+                                    [&mtx, session, seq]()
+                                    {
+                                        std::lock_guard<std::mutex> lock(mtx);
+                                        std::cout << "session " << session << " event " << seq
+                                                  << " in thread " << std::this_thread::get_id()
+                                                  << std::endl;
+                                    });
+        }
+    }
+
+    // 无状态的任务交给最空闲的事件循环
+    std::atomic<int> done(0);
+    for (int i = 0; i < 100; i++)
+    {
+        group.post_event([&done]() { done++; }, cutl::eventloop_balance::least_loaded);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::cout << "stateless tasks done: " << done.load() << std::endl;
+    group.stop();
+}
+
+void print_histogram(const std::string& name, const cutl::histogram_snapshot& snap)
+{
+    std::cout << name << " count:" << snap.count << ", mean:" << snap.mean() / 1000
+              << "us, p99:" << snap.percentile(99) / 1000.0 << "us, max:" << snap.max / 1000.0
+              << "us" << std::endl;
+}
+
+void test_eventloop_stats()
+{
+    PrintSubTitle("eventloop stats");
+
+    cutl::singlethread_eventloop loop("StatsLoop", 1024);
+    // 执行时间超过5ms的任务视为慢任务
+    loop.set_slow_handler_callback(std::chrono::milliseconds(5),
+                                   [](const std::string& name, cutl::EventloopDuration cost)
+                                   {
+                                       std::cout << "slow handler [" << name << "] cost "
+                                                 << std::chrono::duration_cast<
+                                                      std::chrono::microseconds>(cost)
+                                                      .count()
+                                                 << "us" << std::endl;
+                                   });
+    loop.start();
+
+    auto handler = loop.post_timer_event("tick", []() {}, std::chrono::milliseconds(10));
+    for (int i = 0; i < 500; i++)
+    {
+        loop.post_event([]() { std::this_thread::sleep_for(std::chrono::microseconds(50)); });
+    }
+    loop.post_event([]() { std::this_thread::sleep_for(std::chrono::milliseconds(20)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    handler.cancel();
+
+    auto stats = loop.stats();
+    std::cout << "tasks:" << stats.executed_tasks << ", timers:" << stats.executed_timers
+              << ", slow handlers:" << stats.slow_handlers << ", iterations:" << stats.iterations
+              << std::endl;
+    print_histogram("queue delay   ", stats.queue_delay);
+    print_histogram("handler time  ", stats.handler_time);
+    print_histogram("timer lateness", stats.timer_lateness);
+    print_histogram("loop lag      ", stats.loop_lag);
+    loop.stop();
+}
+
 void TestEventLoop()
 {
     PrintTitle("Test EventLoop");
@@ -138,4 +434,12 @@ void TestEventLoop()
     // test_eventloop();
     test_singlethread_eventloop();
     // test_multithread_eventloop();
+    // benchmark_timer_backends();
+    // benchmark_timer_cancels();
+    // test_eventloop_group();
+    // test_eventloop_overflow();
+    // test_eventloop_stats();
+#if defined(__linux__)
+    // test_eventloop_fd();
+#endif
 }
\ No newline at end of file
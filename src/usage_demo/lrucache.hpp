@@ -1,5 +1,11 @@
 ﻿#include "common.hpp"
 #include "common_util/lrucache.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <vector>
 
 void case_01_02()
 {
@@ -105,6 +111,265 @@ void case_03()
     std::cout << "get(Spencer): " << cache.get("Spencer").name << std::endl; // Undefined
 }
 
+void case_03_no_copy()
+{
+    PrintSubTitle("case 03: lookup without copying");
+
+    using PersonCache = cutl::lru_cache<std::string, Person>;
+    PersonCache cache(2);
+    cache.put(std::string("Spencer"), Person("Spencer", 25)); // 移动key和value
+    cache.emplace("Alex", "Alex", 35);                         // 原地构造value
+
+    // 复用out的内存，不存在时返回false
+    Person out;
+    if (cache.try_get("Alex", out))
+    {
+        std::cout << "try_get(Alex): " << out.name << ", " << out.age << std::endl;
+    }
+
+    // 共享节点的所有权，不复制value；元素被淘汰后指针仍然有效
+    auto spencer = cache.get_ptr("Spencer");
+    cache.put("Tom", Person("Tom", 30));
+    cache.put("Jerry", Person("Jerry", 20));
+    std::cout << "exist(Spencer): " << cache.exist("Spencer") << ", get_ptr(Spencer): "
+              << spencer->name << ", " << spencer->age << std::endl;
+
+#if __cplusplus >= 201703L
+    // 透明哈希: 使用std::string_view查找std::string类型的key
+    cutl::lru_cache<std::string, int, cutl::string_hash, std::equal_to<>> ages(4);
+    ages.put("Spencer", 25);
+    std::string_view name = "Spencer";
+    std::cout << "get(string_view): " << ages.get(name) << std::endl;
+#endif
+}
+
+void case_03_ttl_weight()
+{
+    PrintSubTitle("case 03: ttl, weight and stats");
+
+    // 容量为100字节，按value的长度计算权重
+    cutl::lru_cache<std::string, std::string> cache(
+      100, [](const std::string& k, const std::string& v) { return k.size() + v.size(); });
+    cache.set_removal_listener(
+      [](const std::string& k, const std::string& /*v*/, cutl::lru_removal_cause cause)
+      {
+          std::cout << "  removed " << k << ", cause: "
+                    << (cause == cutl::lru_removal_cause::evicted ? "evicted" : "expired")
+                    << std::endl;
+      });
+
+    cache.put("token", std::string(20, 't'), std::chrono::milliseconds(50)); // 50ms后过期
+    cache.put("page1", std::string(40, 'a'));
+    cache.put("page2", std::string(40, 'b')); // 超出100字节，淘汰最久未使用的token
+    std::cout << "weight: " << cache.weight() << ", size: " << cache.size() << std::endl;
+
+    cache.put("session", "abc", std::chrono::milliseconds(20));
+    cache.put("captcha", "1234", std::chrono::milliseconds(20));
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    // 查找时发现已过期，移除并返回默认值
+    auto session = cache.get("session");
+    std::cout << "get(session): \"" << session << "\"" << std::endl;
+    // 后台过期: 可以用set_interval()定期调用purge_expired()
+    auto purged = cache.purge_expired();
+    std::cout << "purge_expired: " << purged << std::endl;
+
+    // 未命中时调用loader加载并放入缓存
+    auto value = cache.get_or_load("config", [](const std::string& k) { return "loaded-" + k; });
+    std::cout << "get_or_load(config): " << value << std::endl;
+
+    auto stats = cache.stats();
+    std::cout << "hits: " << stats.hits << ", misses: " << stats.misses
+              << ", evictions: " << stats.evictions << ", expirations: " << stats.expirations
+              << ", hit rate: " << stats.hit_rate() << ", load time: "
+              << stats.total_load_time.count() << "ns" << std::endl;
+}
+
+void case_04_sharded()
+{
+    PrintSubTitle("case 04: sharded lru cache");
+
+    cutl::sharded_lru_cache<int, int> cache(8, 2);
+    for (int i = 0; i < 10; i++)
+    {
+        cache.put(i, i * i);
+    }
+    std::cout << "shard_count: " << cache.shard_count() << ", capacity: " << cache.capacity()
+              << ", size: " << cache.size() << std::endl;
+    std::cout << "[ ";
+    cache.for_each([](int k, int v) { std::cout << k << ":" << v << " "; });
+    std::cout << "]" << std::endl;
+    std::cout << "exist(9): " << cache.exist(9) << ", get(9): " << cache.get(9) << std::endl;
+
+    // lazy模式: 所有元素都被访问过(标记)时，新元素仍然可以放入，淘汰的是标记清除后的队尾元素
+    cutl::sharded_lru_cache<int, int> lazy_cache(4, 1, cutl::lru_recency::lazy);
+    for (int i = 0; i < 4; i++)
+    {
+        lazy_cache.put(i, i);
+        lazy_cache.get(i);
+    }
+    lazy_cache.put(100, 100);
+    std::cout << "lazy: exist(100): " << lazy_cache.exist(100) << ", size: " << lazy_cache.size()
+              << std::endl; // 1, 4
+}
+
+void case_05_slab()
+{
+    PrintSubTitle("case 05: slab lru cache");
+
+    cutl::slab_lru_cache<std::string, Person> cache(2);
+    cache.put("Spencer", Person("Spencer", 25));
+    cache.put("Alex", Person("Alex", 35));
+    std::cout << "get(Spencer): " << cache.get("Spencer").name << std::endl; // Spencer
+    // 淘汰Alex，复用其节点
+    cache.put("Tom", Person("Tom", 30));
+    std::cout << "[ ";
+    cache.for_each([](const std::string& k, const Person&) { std::cout << k << " "; });
+    std::cout << "]" << std::endl; // Tom Spencer
+    std::cout << "exist(Alex): " << cache.exist("Alex") << ", size: " << cache.size() << std::endl;
+}
+
+// 生成服从Zipf分布的key序列，模拟热点数据的访问
+std::vector<int> make_zipf_keys(int key_count, double skew, size_t length, uint32_t seed)
+{
+    std::vector<double> cdf(key_count);
+    double sum = 0;
+    for (int i = 0; i < key_count; i++)
+    {
+        sum += 1.0 / std::pow(i + 1, skew);
+        cdf[i] = sum;
+    }
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> dist(0, sum);
+    std::vector<int> keys(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        keys[i] = static_cast<int>(std::lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin());
+    }
+    return keys;
+}
+
+// 多线程执行get，未命中时put，统计吞吐量和命中率
+template<typename Cache>
+void benchmark_lru_cache(const std::string& name,
+                         Cache& cache,
+                         const std::vector<std::vector<int>>& thread_keys)
+{
+    std::atomic<uint64_t> hits(0);
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& keys : thread_keys)
+    {
+        threads.emplace_back(
+          [&cache, &keys, &hits]()
+          {
+              uint64_t local_hits = 0;
+              for (int key : keys)
+              {
+                  // value为key+1，0表示未命中
+                  if (cache.get(key) != 0)
+                  {
+                      local_hits++;
+                  }
+                  else
+                  {
+                      cache.put(key, key + 1);
+                  }
+              }
+              hits += local_hits;
+          });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t total = 0;
+    for (const auto& keys : thread_keys)
+    {
+        total += keys.size();
+    }
+    std::cout << "  " << name << ": " << static_cast<uint64_t>(total / cost / 1000) << " kops/s"
+              << ", hit rate: " << 100.0 * hits / total << "%" << std::endl;
+}
+
+void BenchmarkLRUCache()
+{
+    PrintSubTitle("benchmark: lru_cache vs sharded_lru_cache");
+
+    const int key_count = 100000;
+    const uint64_t capacity = 10000;
+    const size_t ops_per_thread = 500000;
+    for (int thread_num : { 1, 2, 4, 8, 16 })
+    {
+        std::vector<std::vector<int>> thread_keys;
+        for (int i = 0; i < thread_num; i++)
+        {
+            thread_keys.push_back(make_zipf_keys(key_count, 0.99, ops_per_thread, 1000 + i));
+        }
+
+        std::cout << thread_num << " threads:" << std::endl;
+        {
+            cutl::lru_cache<int, int> cache(capacity);
+            benchmark_lru_cache("lru_cache                ", cache, thread_keys);
+        }
+        {
+            cutl::sharded_lru_cache<int, int> cache(capacity, 0, cutl::lru_recency::exact);
+            benchmark_lru_cache("sharded_lru_cache(exact) ", cache, thread_keys);
+        }
+        {
+            cutl::sharded_lru_cache<int, int> cache(capacity, 0, cutl::lru_recency::lazy);
+            benchmark_lru_cache("sharded_lru_cache(lazy)  ", cache, thread_keys);
+        }
+    }
+}
+
+// 高频淘汰的场景: key的范围远大于容量，大部分put都会淘汰旧元素
+template<typename Cache>
+void benchmark_lru_churn(const std::string& name, Cache& cache, const std::vector<int>& keys)
+{
+    uint64_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int key : keys)
+    {
+        if (cache.get(key) != 0)
+        {
+            hits++;
+        }
+        else
+        {
+            cache.put(key, key + 1);
+        }
+    }
+    auto cost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "  " << name << ": " << static_cast<uint64_t>(keys.size() / cost / 1000)
+              << " kops/s, hit rate: " << 100.0 * hits / keys.size() << "%" << std::endl;
+}
+
+void BenchmarkSlabLRUCache()
+{
+    PrintSubTitle("benchmark: lru_cache vs slab_lru_cache");
+
+    const uint32_t capacity = 100000;
+    std::mt19937 rng(2024);
+    std::uniform_int_distribution<int> dist(0, capacity * 4);
+    std::vector<int> keys(5000000);
+    for (auto& key : keys)
+    {
+        key = dist(rng);
+    }
+
+    {
+        cutl::lru_cache<int, int> cache(capacity);
+        benchmark_lru_churn("lru_cache     ", cache, keys);
+    }
+    {
+        cutl::slab_lru_cache<int, int> cache(capacity);
+        benchmark_lru_churn("slab_lru_cache", cache, keys);
+    }
+}
+
 void TestLRUCache()
 {
     PrintTitle("LRU Cache Usage Demo");
@@ -112,4 +377,10 @@ void TestLRUCache()
     case_01_02();
     // case_02();
     case_03();
+    case_03_no_copy();
+    case_03_ttl_weight();
+    case_04_sharded();
+    case_05_slab();
+    // BenchmarkLRUCache();
+    // BenchmarkSlabLRUCache();
 }
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "algoutil.hpp"
 #include "bitmap.hpp"
 #include "bloomfilter.hpp"
+#include "cachepolicy.hpp"
 #include "common.hpp"
 #include "config.hpp"
+#include "coroutine.hpp"
 #include "datetime.hpp"
 #include "dlloader.hpp"
 #include "eventloop.hpp"
@@ -12,6 +14,7 @@
 #include "hyperloglog.hpp"
 #include "lrucache.hpp"
 #include "observer.hpp"
+#include "parallel.hpp"
 #include "print.hpp"
 #include "singleton.hpp"
 #include "statemachine.hpp"
@@ -54,9 +57,12 @@ int main(int argc, char* argv[])
     // TestPrint();
     // TestTimer();
     // TestLRUCache();
+    // TestCachePolicy();
     // TestThreadUtil();
     // TestEventLoop();
+    // TestCoroutine();
     // TestThreadPool();
+    // TestParallel();
     // TestAlgorithmUtil();
     // BitmapTest();
     // TestHash();
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "common.hpp"
+#include "common_util/parallel.h"
+#include "common_util/timeutil.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+// 返回函数的执行时间，单位: 毫秒
+template<typename Func>
+uint64_t parallel_cost_ms(Func func)
+{
+    auto start = cutl::timestamp(cutl::timeunit::ms);
+    func();
+    return cutl::timestamp(cutl::timeunit::ms) - start;
+}
+
+void TestParallelFor(cutl::threadpool& pool)
+{
+    PrintSubTitle("parallel_for & parallel_transform");
+
+    constexpr int size = 10000000;
+    std::vector<double> input(size);
+    std::vector<double> output(size);
+    std::iota(input.begin(), input.end(), 0.0);
+
+    auto t1 = parallel_cost_ms(
+      [&]()
+      {
+          for (int i = 0; i < size; i++)
+          {
+              output[i] = std::sqrt(input[i]) * std::sin(input[i]);
+          }
+      });
+    auto t2 = parallel_cost_ms(
+      [&]()
+      {
+          cutl::parallel_for(pool,
+                             0,
+                             size,
+                             [&](int i) { output[i] = std::sqrt(input[i]) * std::sin(input[i]); });
+      });
+    auto t3 = parallel_cost_ms(
+      [&]()
+      {
+          cutl::parallel_transform(pool,
+                                   input.begin(),
+                                   input.end(),
+                                   output.begin(),
+                                   [](double x) { return std::sqrt(x) * std::sin(x); });
+      });
+    std::cout << "for loop: " << t1 << "ms, parallel_for: " << t2
+              << "ms, parallel_transform: " << t3 << "ms" << std::endl;
+}
+
+void TestParallelReduce(cutl::threadpool& pool)
+{
+    PrintSubTitle("parallel_reduce");
+
+    constexpr int size = 50000000;
+    std::vector<uint64_t> input(size);
+    std::iota(input.begin(), input.end(), 1);
+
+    uint64_t sum1 = 0;
+    uint64_t sum2 = 0;
+    auto t1 = parallel_cost_ms(
+      [&]() { sum1 = std::accumulate(input.begin(), input.end(), static_cast<uint64_t>(0)); });
+    auto t2 = parallel_cost_ms(
+      [&]()
+      {
+          sum2 = cutl::parallel_reduce(pool,
+                                       input.begin(),
+                                       input.end(),
+                                       static_cast<uint64_t>(0),
+                                       [](uint64_t a, uint64_t b) { return a + b; });
+      });
+    std::cout << "std::accumulate: " << sum1 << " " << t1 << "ms, parallel_reduce: " << sum2 << " "
+              << t2 << "ms" << std::endl;
+
+    // op的类型为T(T, T)，元素类型与结果类型不同时(如字符串的总长度)，先用parallel_transform转换
+    std::vector<std::string> words(1000000);
+    for (size_t i = 0; i < words.size(); i++)
+    {
+        words[i] = std::to_string(i);
+    }
+    std::vector<size_t> lengths(words.size());
+    cutl::parallel_transform(pool,
+                             words.begin(),
+                             words.end(),
+                             lengths.begin(),
+                             [](const std::string& s) { return s.size(); });
+    size_t total = cutl::parallel_reduce(pool,
+                                         lengths.begin(),
+                                         lengths.end(),
+                                         static_cast<size_t>(0),
+                                         [](size_t a, size_t b) { return a + b; });
+    size_t expected = std::accumulate(words.begin(),
+                                      words.end(),
+                                      static_cast<size_t>(0),
+                                      [](size_t a, const std::string& s) { return a + s.size(); });
+    std::cout << "total length of the words: " << total << ", std::accumulate: " << expected
+              << std::endl;
+}
+
+void TestParallelSort(cutl::threadpool& pool)
+{
+    PrintSubTitle("parallel_sort");
+
+    constexpr int size = 10000000;
+    std::mt19937 rng(2025);
+    std::vector<uint32_t> data1(size);
+    for (auto& v : data1)
+    {
+        v = rng();
+    }
+    auto data2 = data1;
+
+    auto t1 = parallel_cost_ms([&]() { std::sort(data1.begin(), data1.end()); });
+    auto t2 = parallel_cost_ms([&]() { cutl::parallel_sort(pool, data2.begin(), data2.end()); });
+    std::cout << "std::sort: " << t1 << "ms, parallel_sort: " << t2
+              << "ms, same result: " << (data1 == data2) << std::endl;
+}
+
+void TestParallel()
+{
+    PrintTitle("parallel algorithms");
+
+    cutl::threadpool pool("parallel");
+    pool.start();
+
+    TestParallelFor(pool);
+    TestParallelReduce(pool);
+    TestParallelSort(pool);
+
+    pool.stop();
+}
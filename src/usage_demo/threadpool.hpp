@@ -4,6 +4,9 @@
 #include "common_util/datetime.h"
 #include "common_util/threadpool.h"
 #include "common_util/threadutil.h"
+#include <ctime>
+#include <memory>
+#include <mutex>
 
 void thread_pool_case_01()
 {
@@ -170,6 +173,271 @@ void thread_pool_case_03()
               << std::endl;
 }
 
+void thread_pool_case_04()
+{
+    PrintSubTitle("thread_pool case 04: work stealing");
+
+    // 工作线程中提交的子任务放入其本地队列，空闲的工作线程从其他线程的队列中窃取任务
+    cutl::threadpool tp("StealPool", 1024, cutl::threadpool_mode::work_stealing);
+    tp.start(4);
+
+    std::atomic<int> done{ 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        tp.add_task(
+          [&tp, &done, i]()
+          {
+              for (int j = 0; j < 8; j++)
+              {
+                  tp.add_task(
+                    [&done, i, j]()
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                        std::cout << "(" << cutl::get_current_thread_tid() << ") sub task " << i
+                                  << "-" << j << std::endl;
+                        done++;
+                    });
+              }
+          });
+    }
+
+    while (done.load() < 32)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    tp.stop();
+    std::cout << "all " << done.load() << " sub tasks done." << std::endl;
+}
+
+void thread_pool_case_05()
+{
+    PrintSubTitle("thread_pool case 05: batch submission");
+
+    cutl::threadpool tp("BatchPool");
+    tp.start(4);
+
+    // 一次性提交一批子任务，只唤醒一次工作线程
+    std::vector<std::function<int()>> funcs;
+    for (int i = 0; i < 10; i++)
+    {
+        funcs.emplace_back([i]() { return i * i; });
+    }
+    auto futures = tp.add_tasks_with_return(funcs);
+
+    int sum = 0;
+    for (auto& f : futures)
+    {
+        sum += f.get();
+    }
+    std::cout << "sum of squares [0, 10): " << sum << std::endl;
+
+    tp.stop();
+}
+
+void thread_pool_case_06()
+{
+    PrintSubTitle("thread_pool case 06: elastic sizing");
+
+    // 线程数在[2, 8]之间伸缩，空闲超过500ms的线程退出
+    cutl::threadpool_sizing sizing;
+    sizing.min_threads = 2;
+    sizing.max_threads = 8;
+    sizing.keep_alive = std::chrono::milliseconds(500);
+    cutl::threadpool tp("ElasticPool");
+    tp.start(sizing);
+
+    for (int i = 0; i < 32; i++)
+    {
+        tp.add_task([]() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::cout << "under backlog, thread count: " << tp.thread_count()
+              << ", peak: " << tp.peak_thread_count() << std::endl;
+
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    std::cout << "after idle, thread count: " << tp.thread_count()
+              << ", peak: " << tp.peak_thread_count() << std::endl;
+
+    tp.stop();
+}
+
+// 统计线程池空闲时的CPU占用和任务的唤醒延迟
+void benchmark_idle_policy(const std::string& name, const cutl::threadpool_idle_policy& policy)
+{
+    cutl::threadpool tp("IdlePool");
+    tp.set_idle_policy(policy);
+    tp.start(4);
+
+    // 空闲1s，统计进程的CPU时间
+    auto cpu_start = std::clock();
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    double idle_cpu_ms = 1000.0 * (std::clock() - cpu_start) / CLOCKS_PER_SEC;
+
+    // 每隔一段时间提交一个任务，统计从提交到开始执行的延迟
+    constexpr int count = 100;
+    int64_t total_ns = 0;
+    for (int i = 0; i < count; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        auto submit_time = std::chrono::steady_clock::now();
+        auto latency = tp.add_task_with_args_and_return(
+          [submit_time]() { return std::chrono::steady_clock::now() - submit_time; });
+        total_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(latency.get()).count();
+    }
+    tp.stop();
+
+    std::cout << name << " idle cpu time: " << idle_cpu_ms
+              << "ms/s, average wakeup latency: " << total_ns / count / 1000.0 << "us"
+              << std::endl;
+}
+
+void thread_pool_case_07()
+{
+    PrintSubTitle("thread_pool case 07: idle policy");
+
+    cutl::threadpool_idle_policy park;
+    park.spin_count = 0;
+    park.yield_count = 0;
+    benchmark_idle_policy("park        ", park);
+
+    cutl::threadpool_idle_policy balanced;
+    benchmark_idle_policy("spin & park ", balanced);
+
+    cutl::threadpool_idle_policy hot;
+    hot.spin_count = 1000000;
+    hot.yield_count = 100000;
+    benchmark_idle_policy("hot spinning", hot);
+}
+
+void thread_pool_case_08()
+{
+    PrintSubTitle("thread_pool case 08: priority lanes");
+
+    cutl::threadpool tp("PriorityPool");
+    tp.start(1);
+
+    // 先用一个任务占住唯一的工作线程，让后续任务在队列中排队
+    tp.add_task([]() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    std::mutex mtx;
+    std::string order;
+    auto record = [&mtx, &order](char c)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        order.push_back(c);
+    };
+    for (int i = 0; i < 8; i++)
+    {
+        tp.add_task([&record]() { record('L'); }, cutl::task_priority::low);
+        tp.add_task([&record]() { record('N'); }, cutl::task_priority::normal);
+        tp.add_task([&record]() { record('H'); }, cutl::task_priority::high);
+    }
+    std::cout << "queue depth, high: " << tp.queue_size(cutl::task_priority::high)
+              << ", normal: " << tp.queue_size(cutl::task_priority::normal)
+              << ", low: " << tp.queue_size(cutl::task_priority::low) << std::endl;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    tp.stop();
+    // 高优先级的任务先执行，低优先级的任务也会周期性地被执行，不会饿死
+    std::cout << "execute order: " << order << std::endl;
+}
+
+void thread_pool_case_09()
+{
+    PrintSubTitle("thread_pool case 09: move-only task");
+
+    cutl::threadpool tp("MoveOnlyPool");
+    tp.start(2);
+
+    // 捕获move-only对象的lambda也可以作为任务
+    std::unique_ptr<std::string> msg(new std::string("hello move-only task"));
+    tp.add_task([&msg]() { std::cout << *msg << std::endl; });
+
+    // 小对象直接存放在任务对象内部，不分配内存
+    int value = 0;
+    cutl::threadpool::Task small([&value]() { value++; });
+    std::cout << "small lambda stored inline: " << small.is_inline()
+              << ", inline buffer size: " << cutl::task_function::buffer_size << std::endl;
+
+    // 返回值通过packaged_task传递，不需要额外的shared_ptr
+    auto result = tp.add_task_with_args_and_return(
+      cutl::task_priority::high, [](const std::unique_ptr<int>& p) { return *p * 2; },
+      std::unique_ptr<int>(new int(21)));
+    std::cout << "result: " << result.get() << std::endl;
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    tp.stop();
+}
+
+void thread_pool_case_10()
+{
+    PrintSubTitle("thread_pool case 10: runtime statistics");
+
+    cutl::threadpool tp("StatsPool", 32);
+    tp.start(4);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        tp.add_task([]() { std::this_thread::sleep_for(std::chrono::microseconds(100)); });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto stats = tp.stats();
+    std::cout << "executed: " << stats.executed << ", rejected: " << stats.rejected
+              << ", queue high water: " << stats.queue_high_water << std::endl;
+    std::cout << "wait time(us), p50: " << stats.wait_time.percentile(50) / 1000
+              << ", p99: " << stats.wait_time.percentile(99) / 1000
+              << ", max: " << stats.wait_time.max / 1000 << std::endl;
+    std::cout << "run time(us), p50: " << stats.run_time.percentile(50) / 1000
+              << ", p99: " << stats.run_time.percentile(99) / 1000 << std::endl;
+    std::cout << "producer blocked: " << stats.block_time.count
+              << " times, mean(us): " << stats.block_time.mean() / 1000 << std::endl;
+    for (auto& worker : stats.workers)
+    {
+        std::cout << "worker " << worker.index << ", executed: " << worker.executed
+                  << ", busy ratio: " << worker.busy_ratio << std::endl;
+    }
+
+    tp.stop();
+}
+
+void thread_pool_case_11()
+{
+    PrintSubTitle("thread_pool case 11: thread placement");
+
+    // 工作线程依次绑定到CPU 0和CPU 1
+    cutl::thread_placement placement;
+    placement.mode = cutl::thread_placement_mode::cpu_list;
+    placement.cpus = { 0, 1 };
+    cutl::threadpool tp("PinnedPool");
+    tp.set_placement(placement);
+    tp.start(2);
+    for (int i = 0; i < 2; i++)
+    {
+        tp.add_task(
+          []()
+          {
+              auto cpus = cutl::get_current_thread_affinity();
+              std::cout << cutl::get_current_thread_name()
+                        << " bound to cpu: " << (cpus.empty() ? -1 : (int)cpus[0]) << std::endl;
+          });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    tp.stop();
+
+    // 每个NUMA节点一个线程池，线程和内存都在本节点
+    auto pools = cutl::threadpool::create_per_numa_node("NodePool", 2);
+    std::cout << "per numa node pools: " << pools.size() << std::endl;
+    for (auto& pool : pools)
+    {
+        if (pool)
+        {
+            pool->stop();
+        }
+    }
+}
+
 void TestThreadPool()
 {
     PrintTitle("Thread Pool Usage Demo");
@@ -177,4 +445,12 @@ void TestThreadPool()
     // thread_pool_case_01();
     // thread_pool_case_02();
     thread_pool_case_03();
+    // thread_pool_case_04();
+    // thread_pool_case_05();
+    // thread_pool_case_06();
+    // thread_pool_case_07();
+    // thread_pool_case_08();
+    // thread_pool_case_09();
+    // thread_pool_case_10();
+    // thread_pool_case_11();
 }
\ No newline at end of file
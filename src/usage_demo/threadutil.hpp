@@ -3,8 +3,52 @@
 #include "common.hpp"
 #include "common_util/threadutil.h"
 #include <iostream>
+#include <string>
 #include <thread>
 
+std::string CpuListToString(const std::vector<uint32_t>& cpus)
+{
+    std::string text;
+    for (auto cpu : cpus)
+    {
+        text += (text.empty() ? "" : ",") + std::to_string(cpu);
+    }
+    return text;
+}
+
+void TestThreadAffinity()
+{
+    PrintSubTitle("thread affinity");
+
+    auto numa_nodes = cutl::get_numa_node_count();
+    std::cout << "NUMA node count: " << numa_nodes << std::endl;
+    for (uint32_t node = 0; node < numa_nodes; node++)
+    {
+        std::cout << "node " << node << " cpus: " << CpuListToString(cutl::get_numa_node_cpus(node))
+                  << std::endl;
+    }
+
+    auto th = std::thread(
+      []()
+      {
+          std::cout << "before binding, cpus: "
+                    << CpuListToString(cutl::get_current_thread_affinity()) << std::endl;
+          cutl::set_current_thread_affinity({ 0 });
+          std::cout << "after binding, cpus: "
+                    << CpuListToString(cutl::get_current_thread_affinity()) << std::endl;
+      });
+    th.join();
+
+    // 线程组的CPU分布: 轮流绑定到各个节点的CPU
+    cutl::thread_placement spread;
+    spread.mode = cutl::thread_placement_mode::spread;
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        std::cout << "spread thread " << i << " cpus: "
+                  << CpuListToString(cutl::get_thread_placement_cpus(spread, i)) << std::endl;
+    }
+}
+
 void TestThreadUtil()
 {
     PrintTitle("Thread Util Demo");
@@ -26,4 +70,6 @@ void TestThreadUtil()
     auto name = cutl::get_current_thread_name();
     auto tid = cutl::get_current_thread_tid();
     std::cout << "Main thread id: " << tid << ", name: " << name << std::endl;
+
+    TestThreadAffinity();
 }
\ No newline at end of file
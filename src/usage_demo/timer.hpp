@@ -2,6 +2,7 @@
 #include "common_util/threadutil.h"
 #include "common_util/timer.h"
 #include <memory>
+#include <vector>
 
 // 示例用法
 void sayHello(const std::string& name)
@@ -20,9 +21,19 @@ void TestSetTimeout()
     cutl::set_timeout(sayHello, 2010, name);
     // lambda object
     cutl::set_timeout([name]() mutable { std::cout << "Lambda after 3 seconds!\n"; }, 3000);
+    // 取消还未执行的任务
+    auto handle = cutl::set_timeout(sayHello, 2500, "Canceled");
+    handle.cancel();
+
+    // 周期执行，直到被取消；所有的set_timeout/set_interval共享同一个线程
+    std::atomic<int> count{ 0 };
+    auto interval = cutl::set_interval([&count]() { count++; }, 500);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1800));
+    interval.cancel();
+    std::cout << "set_interval runs " << count.load() << " times" << std::endl;
 
     // 主线程等待足够时间以确保异步任务完成
-    std::this_thread::sleep_for(std::chrono::milliseconds(4000));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2200));
     std::cout << "Main thread after 4 seconds.name:" << name << std::endl;
 }
 
@@ -139,6 +150,71 @@ void TestTimerCase_6()
     std::this_thread::sleep_for(std::chrono::seconds(4));
 }
 
+void PrintTimerStats(const std::string& name, const cutl::timer& timer)
+{
+    auto stats = timer.stats();
+    std::cout << name << " runs:" << stats.run_count << ", skipped:" << stats.skipped_count
+              << ", lateness(us) last:" << stats.last_lateness.count() / 1000
+              << ", max:" << stats.max_lateness.count() / 1000
+              << ", mean:" << stats.mean_lateness.count() / 1000 << std::endl;
+}
+
+void TestTimerCase_7()
+{
+    // 【Case7】 固定频率 与 固定延迟: 任务执行时间(150ms)超过周期(100ms)
+    auto slow_task = []() { std::this_thread::sleep_for(std::chrono::milliseconds(150)); };
+    cutl::timer rate_timer(
+      "TimerTest-7a", slow_task, std::chrono::milliseconds(100), cutl::timer_mode::fixed_rate);
+    rate_timer.start();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    rate_timer.stop();
+    PrintTimerStats("fixed_rate ", rate_timer);
+
+    cutl::timer delay_timer(
+      "TimerTest-7b", slow_task, std::chrono::milliseconds(100), cutl::timer_mode::fixed_delay);
+    delay_timer.start();
+    std::this_thread::sleep_for(std::chrono::seconds(2));
+    delay_timer.stop();
+    PrintTimerStats("fixed_delay", delay_timer);
+}
+
+void TestTimerCase_8()
+{
+    // 【Case8】 大量定时器共享一个线程，以及高精度模式(到期前自旋等待)
+    std::atomic<int> count{ 0 };
+    std::vector<std::unique_ptr<cutl::timer>> timers;
+    for (int i = 0; i < 300; i++)
+    {
+        timers.emplace_back(new cutl::timer("Job-" + std::to_string(i),
+                                            [&count]() { count++; },
+                                            std::chrono::milliseconds(100 + i % 10)));
+        timers.back()->start();
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    for (auto& timer : timers)
+    {
+        timer->stop();
+    }
+    std::cout << "300 timers on one thread, runs:" << count.load() << std::endl;
+    PrintTimerStats("Job-0      ", *timers[0]);
+
+    for (bool high_resolution : { false, true })
+    {
+        cutl::timer_service_options options;
+        options.high_resolution = high_resolution;
+        cutl::timer_service service(high_resolution ? "HighResTimer" : "NormalTimer", options);
+        cutl::timer timer("TimerTest-8",
+                          []() {},
+                          std::chrono::microseconds(500),
+                          cutl::timer_mode::fixed_rate,
+                          &service);
+        timer.start();
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        timer.stop();
+        PrintTimerStats(high_resolution ? "high_res   " : "normal     ", timer);
+    }
+}
+
 void TestTimerClass()
 {
     PrintSubTitle("timer");
@@ -155,6 +231,10 @@ void TestTimerClass()
     // TestTimerCase_5();
     // 暂停再继续
     // TestTimerCase_6();
+    // 固定频率 与 固定延迟
+    // TestTimerCase_7();
+    // 大量定时器共享线程，高精度模式
+    // TestTimerCase_8();
 
     std::cout << "Main thread finished." << std::endl;
 }